@@ -0,0 +1,421 @@
+#include <ecs/world.hpp>
+#include <ecs/system.hpp>
+#include <ecs/entity.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using ecs::entity::Entity;
+using ecs::entity::EntityHandle;
+using ecs::registry::ComponentPool;
+using ecs::registry::Layout;
+using ecs::system::BatchSystem;
+using ecs::system::System;
+using ecs::world::StorageMode;
+using ecs::world::World;
+using ecs::world::WorldResource;
+
+/**
+ * Benchmarks of the core World operations at increasing numbers of Entities.
+ * 
+ * Usage: ecs_bench [max_entities] [threads]
+ * 
+ * The number of Entities goes up by a factor of 10 from 1000 to max_entities (1000000 by
+ * default). Every result is printed as a CSV row to stdout:
+ * 
+ *      benchmark,storage,threads,entities,param,ops,total_ns,ns_per_op
+ * 
+ * where param is specific to the benchmark, e.g. the selectivity of a fetch, and ops is
+ * the number of operations total_ns is divided by.
+ * 
+ * The integrate and sum_x benchmarks compare Position and Velocity stored as AoS and
+ * SoA, with param giving the layout, and a per-entity System with a BatchSystem and
+ * kernels run with World::for_each_chunk().
+ */
+
+struct Position
+{
+    int64_t x;
+    int64_t y;
+};
+
+struct Velocity
+{
+    int64_t dx;
+    int64_t dy;
+};
+
+template <>
+struct ecs::soa::Fields<Position> : ecs::soa::FieldList<&Position::x, &Position::y>
+{
+};
+
+template <>
+struct ecs::soa::Fields<Velocity> : ecs::soa::FieldList<&Velocity::dx, &Velocity::dy>
+{
+};
+
+struct Tag
+{
+};
+
+struct Unused
+{
+};
+
+using Clock = std::chrono::steady_clock;
+
+static size_t n_threads = 0;
+static volatile int64_t sink = 0;
+
+template <class F>
+double time_ns(F f)
+{
+    auto start = Clock::now();
+    f();
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+void report(const std::string &benchmark, StorageMode storage, size_t entities, const std::string &param, size_t ops, double ns)
+{
+    std::cout << benchmark << ","
+              << (storage == StorageMode::SparseSet ? "sparse_set" : "archetype") << ","
+              << n_threads << ","
+              << entities << ","
+              << param << ","
+              << ops << ","
+              << static_cast<uint64_t>(ns) << ","
+              << (ops > 0 ? ns / ops : 0.0) << std::endl;
+}
+
+World make_world(StorageMode storage, Layout layout = Layout::AoS)
+{
+    return World::create()
+        .with_storage(storage)
+        .with_threads(n_threads)
+        .with_component<Position>(layout)
+        .with_component<Velocity>(layout)
+        .with_component<Tag>()
+        .with_component<Unused>()
+        .build();
+}
+
+std::vector<EntityHandle> spawn(World &world, size_t n)
+{
+    std::vector<Position> positions(n);
+    std::vector<Velocity> velocities(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        positions[i] = {static_cast<int64_t>(i), 0};
+        velocities[i] = {1, 1};
+    }
+    return world.spawn_batch<Position, Velocity>(n, positions.data(), velocities.data());
+}
+
+class TagAdder : public System<Entity, WorldResource, const Position>
+{
+public:
+    void run(system_data data)
+    {
+        std::get<1>(data)->add_component_to_entity<Tag>(std::get<0>(data), {});
+    }
+};
+
+class TagRemover : public System<Entity, WorldResource, const Tag>
+{
+public:
+    void run(system_data data)
+    {
+        std::get<1>(data)->remove_entity_component<Tag>(std::get<0>(data));
+    }
+};
+
+class Despawner : public System<WorldResource>
+{
+private:
+    std::vector<EntityHandle> handles;
+    size_t count;
+
+public:
+    Despawner(std::vector<EntityHandle> handles, size_t count) : handles(std::move(handles)), count(count) {}
+    void run(system_data data)
+    {
+        WorldResource *world_res = std::get<0>(data);
+        for (size_t i = 0; i < this->count; i++)
+            world_res->remove_entity(world_res->world()->get_entity(this->handles[i]));
+    }
+};
+
+class Integrate : public System<Position, const Velocity>
+{
+public:
+    void run(system_data data)
+    {
+        std::get<0>(data)->x += std::get<1>(data)->dx;
+        std::get<0>(data)->y += std::get<1>(data)->dy;
+    }
+};
+
+class IntegrateBatch : public BatchSystem<Position, const Velocity>
+{
+public:
+    void run(batch_data data)
+    {
+        auto p = std::get<0>(data);
+        auto v = std::get<1>(data);
+        for (size_t i = 0; i < p.size(); i++)
+        {
+            p[i].x += v[i].dx;
+            p[i].y += v[i].dy;
+        }
+    }
+};
+
+/**
+ * Adds the Velocities to the Positions of a chunk, a column at a time.
+ */
+void integrate_chunk(size_t n, ComponentPool<Position> &positions, ComponentPool<Velocity> &velocities)
+{
+    if (auto *p = positions.columns())
+    {
+        auto *v = velocities.columns();
+        int64_t *x = p->column<0>();
+        int64_t *y = p->column<1>();
+        const int64_t *dx = v->column<0>();
+        const int64_t *dy = v->column<1>();
+        for (size_t i = 0; i < n; i++)
+            x[i] += dx[i];
+        for (size_t i = 0; i < n; i++)
+            y[i] += dy[i];
+        return;
+    }
+
+    Position *p = positions.data();
+    const Velocity *v = velocities.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        p[i].x += v[i].dx;
+        p[i].y += v[i].dy;
+    }
+}
+
+/**
+ * Sums the x field of the Positions of a chunk.
+ */
+int64_t sum_x_chunk(size_t n, ComponentPool<Position> &positions)
+{
+    int64_t sum = 0;
+    if (auto *p = positions.columns())
+    {
+        const int64_t *x = p->column<0>();
+        for (size_t i = 0; i < n; i++)
+            sum += x[i];
+        return sum;
+    }
+
+    const Position *p = positions.data();
+    for (size_t i = 0; i < n; i++)
+        sum += p[i].x;
+    return sum;
+}
+
+class EmptySystem : public System<const Unused>
+{
+public:
+    void run(system_data) {}
+};
+
+void bench_create(StorageMode storage, size_t n)
+{
+    {
+        World world = make_world(storage);
+        double ns = time_ns([&]() {
+            for (size_t i = 0; i < n; i++)
+                world.build_entity().with<Position>({static_cast<int64_t>(i), 0}).with<Velocity>({1, 1}).build();
+        });
+        report("build_entity", storage, n, "", n, ns);
+    }
+    {
+        World world = make_world(storage);
+        double ns = time_ns([&]() { spawn(world, n); });
+        report("spawn_batch", storage, n, "", n, ns);
+    }
+}
+
+void bench_add_remove(StorageMode storage, size_t n)
+{
+    {
+        World world = make_world(storage);
+        spawn(world, n);
+        TagAdder adder;
+        world.add_systems().add_system(&adder, "TagAdder", {}).done();
+        double ns = time_ns([&]() { world.dispatch(); });
+        report("add_component", storage, n, "", n, ns);
+    }
+    {
+        World world = make_world(storage);
+        std::vector<Position> positions(n);
+        std::vector<Tag> tags(n);
+        world.spawn_batch<Position, Tag>(n, positions.data(), tags.data());
+        TagRemover remover;
+        world.add_systems().add_system(&remover, "TagRemover", {}).done();
+        double ns = time_ns([&]() { world.dispatch(); });
+        report("remove_component", storage, n, "", n, ns);
+    }
+}
+
+void bench_fetch(StorageMode storage, size_t n)
+{
+    for (double selectivity : {1.0, 0.5, 0.1, 0.01})
+    {
+        World world = make_world(storage);
+        size_t stride = static_cast<size_t>(1.0 / selectivity);
+        for (size_t i = 0; i < n; i++)
+        {
+            auto builder = world.build_entity();
+            builder.with<Position>({static_cast<int64_t>(i), 0});
+            if (i % stride == 0)
+                builder.with<Velocity>({1, 1});
+            builder.build();
+        }
+
+        // Repeat small fetches so that each measurement visits at least ~1e6 Entities.
+        size_t reps = std::max<size_t>(1, 1000000 / n);
+        double ns = time_ns([&]() {
+            int64_t sum = 0;
+            for (size_t r = 0; r < reps; r++)
+            {
+                for (auto item : world.fetch<Position, Velocity>())
+                    sum += std::get<0>(item)->x + std::get<1>(item)->dx;
+            }
+            sink = sum;
+        });
+        report("fetch", storage, n, std::to_string(selectivity), reps * n, ns);
+
+        ns = time_ns([&]() {
+            int64_t sum = 0;
+            for (size_t r = 0; r < reps; r++)
+            {
+                for (auto item : world.safe_fetch<Position, Velocity>())
+                    sum += std::get<0>(item)->x + std::get<1>(item)->dx;
+            }
+            sink = sum;
+        });
+        report("safe_fetch", storage, n, std::to_string(selectivity), reps * n, ns);
+    }
+}
+
+void bench_merge(StorageMode storage, size_t n)
+{
+    for (size_t k : {static_cast<size_t>(1), n / 100, n / 10, n})
+    {
+        if (k == 0)
+            continue;
+        World world = make_world(storage);
+        Despawner despawner(spawn(world, n), k);
+        world.add_systems().add_system(&despawner, "Despawner", {}).done();
+        double ns = time_ns([&]() { world.dispatch(); });
+        report("merge_removals", storage, n, std::to_string(k), k, ns);
+    }
+}
+
+void bench_layout(StorageMode storage, size_t n)
+{
+    for (Layout layout : {Layout::AoS, Layout::SoA})
+    {
+        std::string param = layout == Layout::AoS ? "aos" : "soa";
+        World world = make_world(storage, layout);
+        spawn(world, n);
+        Integrate integrate;
+        world.add_systems().add_system(&integrate, "Integrate", {}).done();
+
+        size_t reps = std::max<size_t>(1, 1000000 / n);
+        world.dispatch();
+        double ns = time_ns([&]() {
+            for (size_t r = 0; r < reps; r++)
+                world.dispatch();
+        });
+        report("integrate_system", storage, n, param, reps * n, ns);
+
+        // A BatchSystem is given arrays of components, so only AoS can be batched.
+        if (layout == Layout::AoS)
+        {
+            World batch_world = make_world(storage, layout);
+            spawn(batch_world, n);
+            IntegrateBatch batch;
+            batch_world.add_systems().add_system(&batch, "IntegrateBatch", {}).done();
+            batch_world.dispatch();
+            ns = time_ns([&]() {
+                for (size_t r = 0; r < reps; r++)
+                    batch_world.dispatch();
+            });
+            report("integrate_batch", storage, n, param, reps * n, ns);
+        }
+
+        // Chunks of more than one component are only contiguous with Archetype storage.
+        if (storage == StorageMode::Archetype)
+        {
+            ns = time_ns([&]() {
+                for (size_t r = 0; r < reps; r++)
+                    world.for_each_chunk<Position, Velocity>(integrate_chunk);
+            });
+            report("integrate_chunk", storage, n, param, reps * n, ns);
+        }
+
+        ns = time_ns([&]() {
+            int64_t sum = 0;
+            for (size_t r = 0; r < reps; r++)
+                world.for_each_chunk<Position>([&sum](size_t n, ComponentPool<Position> &positions) { sum += sum_x_chunk(n, positions); });
+            sink = sum;
+        });
+        report("sum_x_chunk", storage, n, param, reps * n, ns);
+    }
+}
+
+void bench_dispatch(StorageMode storage)
+{
+    for (size_t n_systems : {1, 16, 64})
+    {
+        World world = make_world(storage);
+        std::vector<EmptySystem> systems(n_systems);
+        auto builder = world.add_systems();
+        for (size_t i = 0; i < n_systems; i++)
+            builder.add_system(&systems[i], "Empty " + std::to_string(i), {});
+        builder.done();
+
+        size_t reps = 10000;
+        world.dispatch();
+        double ns = time_ns([&]() {
+            for (size_t r = 0; r < reps; r++)
+                world.dispatch();
+        });
+        report("dispatch_empty", storage, 0, std::to_string(n_systems), reps, ns);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max_entities = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    unsigned int hardware_threads = std::thread::hardware_concurrency();
+    n_threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : (hardware_threads > 1 ? hardware_threads - 1 : 0);
+
+    std::cout << "benchmark,storage,threads,entities,param,ops,total_ns,ns_per_op" << std::endl;
+    for (StorageMode storage : {StorageMode::SparseSet, StorageMode::Archetype})
+    {
+        for (size_t n = 1000; n <= max_entities; n *= 10)
+        {
+            bench_create(storage, n);
+            bench_add_remove(storage, n);
+            bench_fetch(storage, n);
+            bench_merge(storage, n);
+            bench_layout(storage, n);
+        }
+        bench_dispatch(storage);
+    }
+}
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <ecs/world.hpp>
 #include <pong/systems.hpp>
+#include <pong/draw_systems.hpp>
 #include <pong/components.hpp>
 #include <pong/resources.hpp>
 #include <math.h>
@@ -40,6 +41,7 @@ auto world = ecs::world::World::create()
                  .with_component<EntityCounter>()
                  .add_resource(KeyboardResource('w', 's', 'i', 'k', ' '))
                  .add_resource<ScoreResource>({0, 0})
+                 .add_resource(ecs::spatial::UniformGrid(50.0))
                  .build();
 
 /**
@@ -112,19 +114,22 @@ void setup_world()
         .with<EntityCounter>({})
         .build();
 
-    // Add Systems to the world.
+    // Add Systems to the world. Systems are ordered by the components they read and
+    // write, so only the dependencies which can't be seen from their access are listed:
+    // the EntityCountSystem counts the Entities through the WorldResource. The drawing
+    // Systems use the GL context, so they run on the main thread.
     world.add_systems()
-        .add_system(&text_renderer, "TextRenderingSystem", {})                                                               // 0
-        .add_system(&renderer, "RenderingSystem", {"TextRenderingSystem"})                                                   // 1
-        .add_system(&keyboard_sys, "KeyboardSystem", {"RenderingSystem"})                                                    // 2
-        .add_system(&spawn_ball_sys, "SpawnBallSystem", {"KeyboardSystem"})                                                  // 3
-        .add_system(&move_sys, "MovementSystem", {"SpawnBallSystem"})                                                        // 4
-        .add_system(&ball_wall_sys, "BallWallCollisionSystem", {"MovementSystem"})                                           // 5
-        .add_system(&wall_sys, "PaddleWallCollisionSystem", {"MovementSystem"})                                              // 5
-        .add_system(&ball_paddle_sys, "BallPaddleCollisionSystem", {"PaddleWallCollisionSystem", "BallWallCollisionSystem"}) // 6
-        .add_system(&score_update_system, "UpdateScoreTextSystem", {"BallWallCollisionSystem"})                              // 6
-        .add_system(&entity_count_sys, "EntityCountSystem", {"BallWallCollisionSystem", "SpawnBallSystem"})                  // 6
-        .add_system(&fps_system, "FPSSystem", {"BallPaddleCollisionSystem"})                                                 // 7
+        .add_main_thread_system(&text_renderer, "TextRenderingSystem", {})
+        .add_main_thread_system(&renderer, "RenderingSystem", {"TextRenderingSystem"})
+        .add_system(&keyboard_sys, "KeyboardSystem", {})
+        .add_system(&spawn_ball_sys, "SpawnBallSystem", {})
+        .add_system(&move_sys, "MovementSystem", {})
+        .add_system(&ball_wall_sys, "BallWallCollisionSystem", {})
+        .add_system(&wall_sys, "PaddleWallCollisionSystem", {})
+        .add_system(&ball_paddle_sys, "BallPaddleCollisionSystem", {})
+        .add_system(&score_update_system, "UpdateScoreTextSystem", {})
+        .add_system(&entity_count_sys, "EntityCountSystem", {"BallWallCollisionSystem", "SpawnBallSystem"})
+        .add_system(&fps_system, "FPSSystem", {})
         .done();
 
     keyboard_res = world.find<KeyboardResource>()->get<KeyboardResource>(0);
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#include <ecs/world.hpp>
+#include <pong/systems.hpp>
+#include <pong/components.hpp>
+#include <pong/resources.hpp>
+
+using namespace pong::components;
+using namespace pong::systems;
+using namespace pong::resource;
+
+/**
+ * A headless run of Pong, for measuring frame times with many balls.
+ * 
+ * Usage: pong_bench [balls] [frames] [threads] [speed]
+ * 
+ * The World and Systems are the same as app/pong.cpp, except that the drawing Systems
+ * do nothing, and the paddles are moved by a script instead of the keyboard. The World
+ * starts with the given number of balls (1000 by default), and balls which leave the
+ * screen are replaced between frames with World::spawn_batch(), so the number of balls
+ * stays the same. The replacements reuse the ids of the removed balls, so a long run
+ * measures a World of a steady size. The balls
+ * move speed units per frame (0.5 by default); a ball faster than the width of a paddle
+ * can only bounce off it if the collision is swept.
+ * 
+ * The frame times of the dispatches are printed as a CSV row to stdout:
+ * 
+ *      balls,threads,frames,speed,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,removed,spawn_mean_ms,spawn_max_ms
+ * 
+ * where removed is the number of balls which left the screen over the run, and the
+ * spawn times are of replacing them after each frame, which isn't part of the frame
+ * times.
+ */
+
+const float WINDOW_SIZE = 500;
+float ball_speed = 0.5;
+const float MAX_BALL_ANGLE = M_PI / 4.0;
+
+/**
+ * Does the same work as DrawSystem, without a GL context.
+ */
+class NullDrawSystem : public ecs::system::System<const Position, const Rectangle, const Color3>
+{
+public:
+    float checksum = 0;
+    void run(system_data data)
+    {
+        this->checksum += std::get<0>(data)->x + std::get<1>(data)->width + std::get<2>(data)->r;
+    }
+};
+
+/**
+ * Does the same work as DrawTextSystem, without a GL context.
+ */
+class NullDrawTextSystem : public ecs::system::System<const Position, const Color3, const Text>
+{
+public:
+    size_t characters = 0;
+    void run(system_data data)
+    {
+        this->characters += std::get<2>(data)->str.size();
+    }
+};
+
+/**
+ * Adds count balls at random places on the screen, moving in random directions.
+ */
+void spawn_balls(ecs::world::World &world, size_t count, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> x_dist(-WINDOW_SIZE + 100, WINDOW_SIZE - 125);
+    std::uniform_real_distribution<float> y_dist(-WINDOW_SIZE + 25, WINDOW_SIZE);
+    std::uniform_real_distribution<float> angle_dist(-MAX_BALL_ANGLE, MAX_BALL_ANGLE);
+    std::bernoulli_distribution left(0.5);
+
+    std::vector<Position> positions(count);
+    std::vector<Velocity> velocities(count);
+    std::vector<Rectangle> rectangles(count, {25.0, 25.0});
+    std::vector<Color3> colors(count, {0.0, 0.0, 0.0});
+    std::vector<Ball> balls(count, {ball_speed});
+    for (size_t i = 0; i < count; i++)
+    {
+        float angle = angle_dist(rng);
+        float x_sign = left(rng) ? -1.0f : 1.0f;
+        positions[i] = {x_dist(rng), y_dist(rng)};
+        velocities[i] = {x_sign * ball_speed * std::cos(angle), ball_speed * std::sin(angle)};
+    }
+    world.spawn_batch<Position, Velocity, Rectangle, Color3, Ball>(
+        count, positions.data(), velocities.data(), rectangles.data(), colors.data(), balls.data());
+}
+
+/**
+ * Moves the paddles up and down in opposite directions, and asks for a ball every frame.
+ */
+void script_input(KeyboardResource *keyboard, size_t frame)
+{
+    bool up = (frame / 120) % 2 == 0;
+    keyboard->PADDLE_STATE_LEFT = up ? KeyboardResource::PaddleState::UP : KeyboardResource::PaddleState::DOWN;
+    keyboard->PADDLE_STATE_RIGHT = up ? KeyboardResource::PaddleState::DOWN : KeyboardResource::PaddleState::UP;
+    keyboard->SHOULD_SPAWN_BALL = true;
+}
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n_balls = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000;
+    size_t n_frames = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 600;
+    unsigned int hardware_threads = std::thread::hardware_concurrency();
+    size_t n_threads = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : (hardware_threads > 1 ? hardware_threads - 1 : 0);
+    ball_speed = argc > 4 ? std::strtof(argv[4], nullptr) : ball_speed;
+
+    auto world = ecs::world::World::create()
+                     .with_threads(n_threads)
+                     .with_component<Position>()
+                     .with_component<Velocity>()
+                     .with_component<Rectangle>()
+                     .with_component<Color3>()
+                     .with_component<Side>()
+                     .with_component<Ball>()
+                     .with_component<BallSpawner>()
+                     .with_component<Text>()
+                     .with_component<FPSCounter>()
+                     .with_component<EntityCounter>()
+                     .add_resource(KeyboardResource('w', 's', 'i', 'k', ' '))
+                     .add_resource<ScoreResource>({0, 0})
+                     .add_resource(ecs::spatial::UniformGrid(50.0))
+                     .build();
+
+    // The same Entities as app/pong.cpp, without fonts.
+    world.build_entity()
+        .with<Position>({-400.0, 100.0})
+        .with<Velocity>({0.0, 0.0})
+        .with<Rectangle>({50.0, 200.0})
+        .with<Color3>({1.0f, 0.0f, 0.0f})
+        .with<Side>(Side::LEFT)
+        .build();
+    world.build_entity()
+        .with<Position>({350, 100})
+        .with<Velocity>({0.0, 0.0})
+        .with<Rectangle>({50.0, 200.0})
+        .with<Color3>({0.0f, 0.0f, 1.0f})
+        .with<Side>(Side::RIGHT)
+        .build();
+    world.build_entity()
+        .with<Position>({-250.0, 400.0})
+        .with<Color3>({0.0, 0.0, 0.0})
+        .with<Side>(Side::LEFT)
+        .with<Text>({"", nullptr})
+        .build();
+    world.build_entity()
+        .with<Position>({250.0, 400.0})
+        .with<Color3>({0.0, 0.0, 0.0})
+        .with<Side>(Side::RIGHT)
+        .with<Text>({"", nullptr})
+        .build();
+    world.build_entity()
+        .with<BallSpawner>({})
+        .build();
+    world.build_entity()
+        .with<Position>({-250.0, -250.0})
+        .with<Color3>({0.0, 0.0, 0.0})
+        .with<Text>({"Press Space to make a ball!", nullptr})
+        .build();
+    world.build_entity()
+        .with<Position>({-450.0, -450.0})
+        .with<Color3>({0.0, 0.0, 0.0})
+        .with<Text>({"", nullptr})
+        .with<FPSCounter>({FPSCounter::Clock::now()})
+        .build();
+    world.build_entity()
+        .with<Position>({250.0, -450.0})
+        .with<Color3>({0.0, 0.0, 0.0})
+        .with<Text>({"", nullptr})
+        .with<EntityCounter>({})
+        .build();
+
+    std::mt19937 rng(475);
+    spawn_balls(world, n_balls, rng);
+
+    NullDrawSystem renderer;
+    NullDrawTextSystem text_renderer;
+    UpdateScoreTextSystem score_update_system;
+    MovementSystem move_sys;
+    PaddleWallCollisionSystem wall_sys(WINDOW_SIZE, WINDOW_SIZE);
+    BallWallCollisionSystem ball_wall_sys(WINDOW_SIZE, WINDOW_SIZE);
+    BallPaddleCollisionSystem ball_paddle_sys(M_PI / 4.0);
+    SpawnBallSystem spawn_ball_sys(n_balls, ball_speed, MAX_BALL_ANGLE);
+    KeyboardSystem keyboard_sys(1.0);
+    FPSSystem fps_system;
+    EntityCountSystem entity_count_sys;
+
+    // The same System graph as app/pong.cpp.
+    world.add_systems()
+        .add_main_thread_system(&text_renderer, "TextRenderingSystem", {})
+        .add_main_thread_system(&renderer, "RenderingSystem", {"TextRenderingSystem"})
+        .add_system(&keyboard_sys, "KeyboardSystem", {})
+        .add_system(&spawn_ball_sys, "SpawnBallSystem", {})
+        .add_system(&move_sys, "MovementSystem", {})
+        .add_system(&ball_wall_sys, "BallWallCollisionSystem", {})
+        .add_system(&wall_sys, "PaddleWallCollisionSystem", {})
+        .add_system(&ball_paddle_sys, "BallPaddleCollisionSystem", {})
+        .add_system(&score_update_system, "UpdateScoreTextSystem", {})
+        .add_system(&entity_count_sys, "EntityCountSystem", {"BallWallCollisionSystem", "SpawnBallSystem"})
+        .add_system(&fps_system, "FPSSystem", {})
+        .done();
+
+    KeyboardResource *keyboard = world.find<KeyboardResource>()->get<KeyboardResource>(0);
+    ScoreResource *score = world.find<ScoreResource>()->get<ScoreResource>(0);
+
+    std::vector<double> frame_ms;
+    std::vector<double> spawn_ms;
+    frame_ms.reserve(n_frames);
+    spawn_ms.reserve(n_frames);
+    for (size_t frame = 0; frame < n_frames; frame++)
+    {
+        script_input(keyboard, frame);
+
+        auto start = std::chrono::steady_clock::now();
+        world.dispatch();
+        frame_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+        start = std::chrono::steady_clock::now();
+        size_t n_alive = world.count<Ball>();
+        if (n_alive < n_balls)
+            spawn_balls(world, n_balls - n_alive, rng);
+        spawn_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    if (frame_ms.empty())
+        return 0;
+    double mean = 0;
+    for (double ms : frame_ms)
+        mean += ms;
+    mean /= frame_ms.size();
+    std::sort(frame_ms.begin(), frame_ms.end());
+    double spawn_mean = 0;
+    for (double ms : spawn_ms)
+        spawn_mean += ms;
+    spawn_mean /= spawn_ms.size();
+
+    std::cout << "balls,threads,frames,speed,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,removed,spawn_mean_ms,spawn_max_ms" << std::endl;
+    std::cout << n_balls << ","
+              << n_threads << ","
+              << n_frames << ","
+              << ball_speed << ","
+              << mean << ","
+              << percentile(frame_ms, 0.50) << ","
+              << percentile(frame_ms, 0.95) << ","
+              << percentile(frame_ms, 0.99) << ","
+              << frame_ms.back() << ","
+              << score->SCORE_LEFT + score->SCORE_RIGHT << ","
+              << spawn_mean << ","
+              << *std::max_element(spawn_ms.begin(), spawn_ms.end()) << std::endl;
+}
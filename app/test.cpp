@@ -498,4 +498,41 @@ int main()
         world_res->remove_entity(e);
         world.dispatch();
     }
+
+    {
+        std::cout << "------------ Duplicate Add ----------" << std::endl;
+        for (auto storage : {ecs::world::StorageMode::SparseSet, ecs::world::StorageMode::Archetype})
+        {
+            auto world = World::create()
+                             .with_storage(storage)
+                             .with_component<ToRemove>()
+                             .build();
+            world.build_entity().build();
+
+            // Both Adders add a ToRemove to the same Entity in one dispatch.
+            ComponentAdder<ToRemove> first_adder;
+            ComponentAdder<ToRemove> second_adder;
+            world.add_systems()
+                .add_system(&first_adder, "First Adder", {})
+                .add_system(&second_adder, "Second Adder", {})
+                .done();
+
+            try
+            {
+                world.dispatch();
+                std::cout << "Adding a component twice didn't throw" << std::endl;
+            }
+            catch (const std::runtime_error &e)
+            {
+                std::cout << "Adding a component twice threw: " << e.what() << std::endl;
+            }
+            std::cout << "ToRemove components: " << world.count<ToRemove>() << std::endl;
+
+            // Removing the component must leave no copy of it behind.
+            auto world_res = world.find<WorldResource>()->get<WorldResource>(0);
+            world_res->remove_entity_component<ToRemove>(world.find<Entity>()->get<Entity>(0));
+            world_res->merge();
+            std::cout << "ToRemove components after removal: " << world.count<ToRemove>() << std::endl;
+        }
+    }
 }
@@ -0,0 +1,301 @@
+#ifndef ecs_archetype_hpp
+#define ecs_archetype_hpp
+#include <vector>
+#include <algorithm>
+#include <ecs/registry.hpp>
+#include <ecs/entity.hpp>
+
+namespace ecs::archetype
+{
+    using ecs::entity::bitset;
+    using ecs::registry::RegistryNode;
+
+    /**
+     * @brief Where an Entity's components are stored in archetype storage.
+     * 
+     * The Entity's components are found in the row 'row' of each Column of the
+     * Archetype at index 'archetype' in the World.
+     * 
+     */
+    struct EntityLocation
+    {
+        size_t archetype;
+        size_t row;
+    };
+
+    /**
+     * @brief A table holding every Entity with exactly the same set of components.
+     * 
+     * Each component of the Archetype is stored in its own Column RegistryNode. The
+     * components of a single Entity are found at the same row of every Column, and the
+     * Entity id of each row is kept by the Archetype. This allows a system to visit only
+     * the tables which match its components, and iterate the Columns linearly.
+     * 
+     * The Entity component itself isn't stored in a Column, as Entities are kept by the
+     * World in the Entity RegistryNode regardless of how their components are stored.
+     * 
+     * Adding or removing a component from an Entity moves the Entity's row to another
+     * Archetype. To avoid searching for the destination Archetype every time, each
+     * Archetype remembers which Archetype is reached by adding or removing each component.
+     * 
+     * Invariants:
+     *      - Every Column has exactly one element per Entity id in entities.
+     *      - The row of an Entity is the same for every Column.
+     */
+    class Archetype
+    {
+    private:
+        bitset component_mask;
+        std::vector<size_t> column_lookup;
+        std::vector<RegistryNode> columns;
+        std::vector<size_t> entities;
+        std::vector<size_t> add_edges;
+        std::vector<size_t> remove_edges;
+
+    public:
+        static constexpr size_t npos = RegistryNode::npos;
+
+        Archetype(bitset mask);
+        ~Archetype() = default;
+
+        const bitset &mask() const;
+        bool matches(const bitset &m) const;
+        size_t size() const;
+        size_t eid_at(size_t row) const;
+
+        void add_column(size_t cid, RegistryNode &&column);
+        RegistryNode *column(size_t cid);
+
+        size_t push_entity(size_t eid);
+        size_t push_row(size_t eid);
+        void reserve(size_t n);
+        size_t move_row(size_t row, Archetype &dst);
+        size_t remove_row(size_t row);
+
+        size_t add_edge(size_t cid) const;
+        size_t remove_edge(size_t cid) const;
+        void set_add_edge(size_t cid, size_t idx);
+        void set_remove_edge(size_t cid, size_t idx);
+    };
+
+    /**
+     * @brief Construct a new Archetype object without any Columns.
+     * 
+     * @param mask - The components of the Entities stored in this Archetype.
+     */
+    Archetype::Archetype(bitset mask) : component_mask(mask)
+    {
+        this->column_lookup = std::vector<size_t>(mask.size(), Archetype::npos);
+        this->add_edges = std::vector<size_t>(mask.size(), Archetype::npos);
+        this->remove_edges = std::vector<size_t>(mask.size(), Archetype::npos);
+    }
+
+    /**
+     * @brief Getter function for the component mask of the Archetype.
+     * 
+     * @return const bitset&
+     */
+    const bitset &Archetype::mask() const
+    {
+        return this->component_mask;
+    }
+
+    /**
+     * @brief Checks if this Archetype has ALL components in the mask.
+     * 
+     * @param m - The bitmask of components.
+     * @return true
+     * @return false
+     */
+    bool Archetype::matches(const bitset &m) const
+    {
+        return ecs::entity::is_subset(m, this->component_mask);
+    }
+
+    /**
+     * @brief Getter function for the number of Entities in this Archetype.
+     * 
+     * @return size_t
+     */
+    size_t Archetype::size() const
+    {
+        return this->entities.size();
+    }
+
+    /**
+     * @brief Getter function for the id of the Entity in a row.
+     * 
+     * @param row
+     * @return size_t - The Entity id.
+     */
+    size_t Archetype::eid_at(size_t row) const
+    {
+        return this->entities[row];
+    }
+
+    /**
+     * @brief Adds a Column for a component to the Archetype.
+     * 
+     * This must be done before any Entity is added to the Archetype.
+     * 
+     * @param cid - The component id.
+     * @param column - An empty Column RegistryNode for the component.
+     */
+    void Archetype::add_column(size_t cid, RegistryNode &&column)
+    {
+        if (!this->entities.empty())
+            throw std::runtime_error("Cannot add a Column to an Archetype with Entities");
+        this->column_lookup.at(cid) = this->columns.size();
+        this->columns.push_back(std::move(column));
+    }
+
+    /**
+     * @brief Getter function for the Column of a component.
+     * 
+     * @param cid - The component id.
+     * @return RegistryNode* - The Column, or nullptr if the Archetype has no such Column.
+     */
+    RegistryNode *Archetype::column(size_t cid)
+    {
+        size_t idx = this->column_lookup[cid];
+        if (idx == Archetype::npos)
+            return nullptr;
+        return &this->columns[idx];
+    }
+
+    /**
+     * @brief Adds an Entity to an Archetype without any Columns.
+     * 
+     * @param eid - The Entity id.
+     * @return size_t - The row of the Entity.
+     */
+    size_t Archetype::push_entity(size_t eid)
+    {
+        if (!this->columns.empty())
+            throw std::runtime_error("Entity components must be added with the Entity");
+        this->entities.push_back(eid);
+        return this->entities.size() - 1;
+    }
+
+    /**
+     * @brief Adds a row for an Entity whose components are appended afterwards.
+     * 
+     * The caller MUST append the Entity's component to every Column of this Archetype,
+     * in the same order as the rows were pushed.
+     * 
+     * @param eid - The Entity id.
+     * @return size_t - The row of the Entity.
+     */
+    size_t Archetype::push_row(size_t eid)
+    {
+        this->entities.push_back(eid);
+        return this->entities.size() - 1;
+    }
+
+    /**
+     * @brief Makes room for n more rows in every Column.
+     * 
+     * @param n - The number of rows about to be added.
+     */
+    void Archetype::reserve(size_t n)
+    {
+        if (this->entities.size() + n > this->entities.capacity())
+            this->entities.reserve(std::max(this->entities.size() + n, this->entities.capacity() * 2));
+        for (auto &column : this->columns)
+            column.reserve(n);
+    }
+
+    /**
+     * @brief Moves a row of this Archetype to the end of another Archetype.
+     * 
+     * Components which the destination Archetype has are moved, and components which it
+     * doesn't have are destroyed. If the destination Archetype has Columns this
+     * Archetype doesn't, then the caller MUST append the missing components to them.
+     * 
+     * The last row of this Archetype is moved into the removed row.
+     * 
+     * @param row - The row to move.
+     * @param dst - The destination Archetype.
+     * @return size_t - The Entity id now stored in row, or npos if row was the last row.
+     */
+    size_t Archetype::move_row(size_t row, Archetype &dst)
+    {
+        for (size_t cid = 0; cid < this->column_lookup.size(); cid++)
+        {
+            size_t idx = this->column_lookup[cid];
+            if (idx == Archetype::npos)
+                continue;
+            RegistryNode *dst_column = dst.column(cid);
+            if (dst_column != nullptr)
+                this->columns[idx].move_to(row, *dst_column);
+        }
+        dst.entities.push_back(this->entities[row]);
+        return this->remove_row(row);
+    }
+
+    /**
+     * @brief Removes a row of this Archetype, destroying its components.
+     * 
+     * The last row of this Archetype is moved into the removed row.
+     * 
+     * @param row - The row to remove.
+     * @return size_t - The Entity id now stored in row, or npos if row was the last row.
+     */
+    size_t Archetype::remove_row(size_t row)
+    {
+        for (auto &column : this->columns)
+            column.swap_remove(row);
+
+        size_t last = this->entities.size() - 1;
+        this->entities[row] = this->entities[last];
+        this->entities.pop_back();
+        return row == last ? Archetype::npos : this->entities[row];
+    }
+
+    /**
+     * @brief Getter function for the Archetype reached by adding a component.
+     * 
+     * @param cid - The component id.
+     * @return size_t - The index of the Archetype in the World, or npos if not known yet.
+     */
+    size_t Archetype::add_edge(size_t cid) const
+    {
+        return this->add_edges[cid];
+    }
+
+    /**
+     * @brief Getter function for the Archetype reached by removing a component.
+     * 
+     * @param cid - The component id.
+     * @return size_t - The index of the Archetype in the World, or npos if not known yet.
+     */
+    size_t Archetype::remove_edge(size_t cid) const
+    {
+        return this->remove_edges[cid];
+    }
+
+    /**
+     * @brief Remember the Archetype reached by adding a component.
+     * 
+     * @param cid - The component id.
+     * @param idx - The index of the Archetype in the World.
+     */
+    void Archetype::set_add_edge(size_t cid, size_t idx)
+    {
+        this->add_edges[cid] = idx;
+    }
+
+    /**
+     * @brief Remember the Archetype reached by removing a component.
+     * 
+     * @param cid - The component id.
+     * @param idx - The index of the Archetype in the World.
+     */
+    void Archetype::set_remove_edge(size_t cid, size_t idx)
+    {
+        this->remove_edges[cid] = idx;
+    }
+
+} // namespace ecs::archetype
+
+#endif
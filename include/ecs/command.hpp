@@ -0,0 +1,273 @@
+#ifndef ecs_command_hpp
+#define ecs_command_hpp
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace ecs::world
+{
+    class World;
+} // namespace ecs::world
+
+namespace ecs::command
+{
+
+    /**
+     * @brief A deferred change to the World.
+     * 
+     * Commands are plain data. What the Command does is decided by the apply function it
+     * was made with, which is instantiated for the type of the component involved. A
+     * Command which adds a component points to the component in the arena of the
+     * CommandBuffer which holds the Command, and has a destroy function for it.
+     * 
+     * Applying a Command consumes its component, even if the apply function throws. A
+     * component whose Command is never applied has to be destroyed with the destroy
+     * function instead.
+     * 
+     */
+    struct Command
+    {
+        size_t eid;
+        size_t cid;
+        void *payload;
+        void (*apply)(ecs::world::World *, const Command &);
+        void (*destroy)(void *);
+    };
+
+    /**
+     * @brief Destroys the component of a Command which isn't applied.
+     * 
+     * @tparam T - The type of the component.
+     * @param payload - The component.
+     */
+    template <class T>
+    void destroy(void *payload)
+    {
+        static_cast<T *>(payload)->~T();
+    }
+
+    /**
+     * @brief The phase of the merge in which a Command is applied.
+     * 
+     * New Entities are spawned first. Components are then added before any are removed,
+     * and Entities are removed last, so that Commands never refer to an Entity which has
+     * already been removed.
+     * 
+     * Each Entity in the Spawn phase starts with a header Command, which has no apply
+     * function and whose eid is the number of component Commands following it. The id
+     * of the new Entity is only decided when it is spawned.
+     */
+    enum class Phase
+    {
+        Spawn,
+        Add,
+        Remove,
+        Despawn,
+    };
+
+    /**
+     * @brief A buffer of Commands made by a single thread.
+     * 
+     * Each thread which runs Systems has its own CommandBuffer, so Commands are appended
+     * without any locking. The Commands of each phase are kept in their own contiguous
+     * vector.
+     * 
+     * The components of Add Commands are moved into an arena of fixed size blocks. The
+     * blocks are never reallocated, so the payload pointers of Commands stay valid as
+     * the arena grows, and the blocks are reused after the buffer is cleared.
+     * 
+     */
+    class CommandBuffer
+    {
+    private:
+        static constexpr size_t BLOCK_SIZE = 4096;
+
+        std::vector<Command> phases[4];
+        std::vector<std::unique_ptr<unsigned char[]>> blocks;
+        std::vector<std::unique_ptr<unsigned char[]>> large_blocks;
+        size_t block;
+        size_t offset;
+        size_t holders;
+        std::atomic<bool> dirty;
+
+        void reset_arena();
+
+        void *allocate(size_t size, size_t align);
+
+    public:
+        CommandBuffer() : block(0), offset(0), holders(0), dirty(false) {}
+        ~CommandBuffer() = default;
+        CommandBuffer(const CommandBuffer &) = delete;
+
+        template <class T>
+        T *emplace(T &&t);
+        void push(Phase phase, const Command &command);
+        const std::vector<Command> &commands(Phase phase) const;
+        bool empty() const;
+        bool has_commands() const;
+        void clear();
+        void acquire();
+        void release();
+    };
+
+    /**
+     * @brief Reserves memory in the arena.
+     * 
+     * Requests larger than a block are given their own block.
+     * 
+     * @param size - The number of bytes.
+     * @param align - The alignment of the bytes.
+     * @return void* - The reserved memory.
+     */
+    void *CommandBuffer::allocate(size_t size, size_t align)
+    {
+        if (size > BLOCK_SIZE)
+        {
+            this->large_blocks.push_back(std::make_unique<unsigned char[]>(size));
+            return this->large_blocks.back().get();
+        }
+
+        this->offset = (this->offset + align - 1) / align * align;
+        if (this->blocks.empty() || this->offset + size > BLOCK_SIZE)
+        {
+            if (!this->blocks.empty())
+                this->block++;
+            if (this->block == this->blocks.size())
+                this->blocks.push_back(std::make_unique<unsigned char[]>(BLOCK_SIZE));
+            this->offset = 0;
+        }
+
+        void *ptr = this->blocks[this->block].get() + this->offset;
+        this->offset += size;
+        return ptr;
+    }
+
+    /**
+     * @brief Moves a component into the arena.
+     * 
+     * The component must be destroyed by the Command it belongs to once it has been
+     * applied.
+     * 
+     * @tparam T - The type of the component.
+     * @param t - The component. This is consumed.
+     * @return T* - The component in the arena.
+     */
+    template <class T>
+    T *CommandBuffer::emplace(T &&t)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "Over-aligned components are not supported");
+        void *ptr = this->allocate(sizeof(T), alignof(T));
+        return new (ptr) T(std::move(t));
+    }
+
+    /**
+     * @brief Appends a Command to a phase.
+     * 
+     * @param phase - The phase in which the Command is applied.
+     * @param command - The Command.
+     */
+    void CommandBuffer::push(Phase phase, const Command &command)
+    {
+        this->phases[static_cast<size_t>(phase)].push_back(command);
+        if (!this->dirty.load(std::memory_order_relaxed))
+            this->dirty.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Getter function for the Commands of a phase.
+     * 
+     * @param phase
+     * @return const std::vector<Command>&
+     */
+    const std::vector<Command> &CommandBuffer::commands(Phase phase) const
+    {
+        return this->phases[static_cast<size_t>(phase)];
+    }
+
+    /**
+     * @brief Checks if there are no Commands.
+     * 
+     * @return true
+     * @return false
+     */
+    bool CommandBuffer::empty() const
+    {
+        for (auto &phase : this->phases)
+        {
+            if (!phase.empty())
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Checks if any Commands have been pushed since the buffer was last cleared.
+     * 
+     * Unlike CommandBuffer::empty(), this is safe to call from any thread while the
+     * owning thread is pushing Commands.
+     * 
+     * @return true
+     * @return false
+     */
+    bool CommandBuffer::has_commands() const
+    {
+        return this->dirty.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Removes every Command, once they have all been applied.
+     * 
+     * The blocks of the arena are kept to be reused, except for those made for large
+     * components. The arena is left alone while it is held, see CommandBuffer::acquire().
+     * 
+     */
+    void CommandBuffer::clear()
+    {
+        for (auto &phase : this->phases)
+            phase.clear();
+        this->dirty.store(false, std::memory_order_relaxed);
+        if (this->holders == 0)
+            this->reset_arena();
+    }
+
+    /**
+     * @brief Marks the arena as holding components which aren't in any Command yet.
+     * 
+     * An EntityBuilder moves its components into the arena as they are given, and only
+     * adds its Commands when it is built. The arena is not reused until every holder has
+     * released it.
+     * 
+     */
+    void CommandBuffer::acquire()
+    {
+        this->holders++;
+    }
+
+    /**
+     * @brief Releases a hold on the arena made by CommandBuffer::acquire().
+     * 
+     */
+    void CommandBuffer::release()
+    {
+        this->holders--;
+        if (this->holders == 0 && this->empty())
+            this->reset_arena();
+    }
+
+    /**
+     * @brief Frees the large blocks, and starts reusing the normal blocks from the start.
+     * 
+     */
+    void CommandBuffer::reset_arena()
+    {
+        this->large_blocks.clear();
+        this->block = 0;
+        this->offset = 0;
+    }
+
+} // namespace ecs::command
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef ecs_query_hpp
+#define ecs_query_hpp
+#include <vector>
+#include <ecs/entity.hpp>
+
+namespace ecs::query
+{
+    using ecs::entity::bitset;
+
+    /**
+     * @brief The cached result of a query for a set of components.
+     * 
+     * A QueryState is owned by the World, and is kept up to date as Entities are built,
+     * removed, or have components added or removed. This means that the Entities
+     * matching a set of components don't have to be searched for on every fetch, and
+     * iterating a query only costs as much as the number of matches.
+     * 
+     * With SparseSet storage the ids of the matching Entities are kept. Like a component
+     * RegistryNode, this is a sparse set so that an Entity can be removed in constant
+     * time. With Archetype storage the indices of the matching Archetypes are kept
+     * instead, since Entities move between Archetypes on their own.
+     * 
+     */
+    class QueryState
+    {
+    private:
+        bitset query_mask;
+        std::vector<size_t> entities;
+        std::vector<size_t> positions;
+        std::vector<size_t> archetype_indices;
+
+    public:
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        QueryState(bitset mask);
+        ~QueryState() = default;
+
+        const bitset &mask() const;
+        bool matches(const bitset &m) const;
+        bool is_affected_by(size_t cid) const;
+
+        void insert(size_t eid);
+        void erase(size_t eid);
+        const std::vector<size_t> &matched_entities() const;
+
+        void add_archetype(size_t idx);
+        const std::vector<size_t> &matched_archetypes() const;
+    };
+
+    /**
+     * @brief Construct a new QueryState object without any matches.
+     * 
+     * @param mask - The components an Entity must have to match the query.
+     */
+    QueryState::QueryState(bitset mask) : query_mask(mask) {}
+
+    /**
+     * @brief Getter function for the mask of the query.
+     * 
+     * @return const bitset&
+     */
+    const bitset &QueryState::mask() const
+    {
+        return this->query_mask;
+    }
+
+    /**
+     * @brief Checks if a set of components has every component of the query.
+     * 
+     * @param m - The bitmask of components.
+     * @return true
+     * @return false
+     */
+    bool QueryState::matches(const bitset &m) const
+    {
+        return ecs::entity::is_subset(this->query_mask, m);
+    }
+
+    /**
+     * @brief Checks if adding or removing a component can change the matches of the query.
+     * 
+     * @param cid - The component id.
+     * @return true
+     * @return false
+     */
+    bool QueryState::is_affected_by(size_t cid) const
+    {
+        return this->query_mask[cid];
+    }
+
+    /**
+     * @brief Adds an Entity to the matches. Nothing is done if it's already matched.
+     * 
+     * @param eid - The Entity id.
+     */
+    void QueryState::insert(size_t eid)
+    {
+        if (eid >= this->positions.size())
+            this->positions.resize(eid + 1, QueryState::npos);
+        if (this->positions[eid] != QueryState::npos)
+            return;
+        this->positions[eid] = this->entities.size();
+        this->entities.push_back(eid);
+    }
+
+    /**
+     * @brief Removes an Entity from the matches. Nothing is done if it isn't matched.
+     * 
+     * The last match is moved into the place of the removed match.
+     * 
+     * @param eid - The Entity id.
+     */
+    void QueryState::erase(size_t eid)
+    {
+        if (eid >= this->positions.size() || this->positions[eid] == QueryState::npos)
+            return;
+        size_t pos = this->positions[eid];
+        size_t last = this->entities.back();
+        this->entities[pos] = last;
+        this->positions[last] = pos;
+        this->entities.pop_back();
+        this->positions[eid] = QueryState::npos;
+    }
+
+    /**
+     * @brief Getter function for the ids of the matching Entities.
+     * 
+     * Only used with SparseSet storage.
+     * 
+     * @return const std::vector<size_t>&
+     */
+    const std::vector<size_t> &QueryState::matched_entities() const
+    {
+        return this->entities;
+    }
+
+    /**
+     * @brief Adds an Archetype to the matches.
+     * 
+     * @param idx - The index of the Archetype in the World.
+     */
+    void QueryState::add_archetype(size_t idx)
+    {
+        this->archetype_indices.push_back(idx);
+    }
+
+    /**
+     * @brief Getter function for the indices of the matching Archetypes.
+     * 
+     * Only used with Archetype storage.
+     * 
+     * @return const std::vector<size_t>&
+     */
+    const std::vector<size_t> &QueryState::matched_archetypes() const
+    {
+        return this->archetype_indices;
+    }
+
+    /**
+     * @brief A typed handle to a QueryState for the components Ts.
+     * 
+     * Queries are made with World::query<Ts...>(), and can then be fetched with
+     * World::fetch(Query<Ts...> &). The QueryState is owned by the World, and Queries
+     * for the same set of components share the same QueryState.
+     * 
+     * @tparam Ts - The components of the query.
+     */
+    template <class... Ts>
+    class Query
+    {
+    private:
+        QueryState *state_ptr;
+
+    public:
+        Query() : state_ptr(nullptr) {}
+        Query(QueryState *state) : state_ptr(state) {}
+        ~Query() = default;
+
+        QueryState *state() const { return this->state_ptr; }
+    };
+
+} // namespace ecs::query
+
+#endif
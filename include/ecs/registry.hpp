@@ -3,12 +3,64 @@
 #include <iostream>
 #include <memory>
 #include <vector>
+#include <algorithm>
 #include <unordered_map>
+#include <atomic>
+#include <cassert>
+#include <type_traits>
+#include <iterator>
 #include <ecs/entity.hpp>
+#include <ecs/soa.hpp>
 
 namespace ecs::registry
 {
 
+    /**
+     * @brief Makes the next unused type id.
+     * 
+     * @return size_t
+     */
+    size_t next_type_id()
+    {
+        static std::atomic<size_t> counter{0};
+        return counter++;
+    }
+
+    /**
+     * @brief Getter function for the type id of T.
+     * 
+     * Every type is given a small, unique id the first time this is called for it, which
+     * stays the same for the rest of the process. Unlike typeid(T).hash_code(), the ids
+     * are dense, so they can be used to index into a vector.
+     * 
+     * @tparam T - The type.
+     * @return size_t - The type id of T.
+     */
+    template <class T>
+    size_t type_id()
+    {
+        static const size_t id = next_type_id();
+        return id;
+    }
+
+    template <class T>
+    class ComponentPool;
+
+    /**
+     * @brief How the elements of a Component RegistryNode are laid out in memory.
+     * 
+     * AoS (array of structs) stores whole components next to each other, and is used
+     * unless a component asks for SoA when it's registered, see 
+     * World::WorldBuilder::with_component(). SoA (struct of arrays) stores each field of
+     * the component in its own aligned column, see ecs::soa::Columns.
+     * 
+     */
+    enum class Layout
+    {
+        AoS,
+        SoA,
+    };
+
     /**
      * @brief A non-templated data structure to hold a generic type.
      * 
@@ -38,16 +90,82 @@ namespace ecs::registry
      *          - There is ALWAYS 1 element in the 0th position of the vector.
      *          - No elements are added or removed from the vector<T> after construction.
      * 
+     * Sparse Set:
+     *      Component RegistryNodes are sparse sets. Alongside the dense vector<T>, the 
+     *      node keeps a dense vector of the Entity id owning each element, and a sparse
+     *      vector mapping an Entity id to the index of its element. This allows an
+     *      Entity's component to be found, and removed, in constant time: a removed
+     *      element is swapped with the last element and popped, and only the sparse
+     *      entry of the moved element has to be fixed.
+     * 
+     *      The following assumptions must be upheld for Component RegistryNodes:
+     *          - data[i] belongs to the Entity with id entities[i].
+     *          - sparse[entities[i]] == i for every element i.
+     * 
+     * Layout:
+     *      The data of a Component or Column RegistryNode of a type with declared 
+     *      ecs::soa::Fields can instead be an ecs::soa::Columns<T>, with one column per
+     *      field. The first invariant then holds for the Columns<T> instead of the 
+     *      vector<T>, and the layout is checked along with the type whenever the data is
+     *      accessed. Since a component stored as SoA has no address, get<T>() and 
+     *      iter<T>() can't be used on such a RegistryNode. It is accessed through a 
+     *      ComponentPool instead, which copies each component out and back in.
+     * 
+     * Columns:
+     *      A Column RegistryNode is a plain vector<T> without the sparse set. Columns are
+     *      used by archetype tables, where the table keeps the Entity id of each row for 
+     *      all of its columns. Since a table doesn't know the types of its columns, the 
+     *      operations which move elements between columns are reached through a table of
+     *      function pointers which is filled in when the RegistryNode is created.
+     * 
      */
     class RegistryNode
     {
+    public:
+        /**
+         * @brief Type erased operations on the data vector.
+         * 
+         * These are instantiated for the T a RegistryNode is created with, so they are
+         * always safe to use on that RegistryNode and on Columns created from it.
+         */
+        struct Operations
+        {
+            RegistryNode (*create_column)();
+            void (*move_to)(RegistryNode &src, size_t i, RegistryNode &dst);
+            void (*swap_remove)(RegistryNode &node, size_t i);
+            void (*erase)(RegistryNode &node, size_t eid);
+            void (*reserve)(RegistryNode &node, size_t n);
+        };
+
     private:
         std::shared_ptr<void> data;
+        const Operations *ops;
+        Layout layout;
+        std::vector<size_t> entities;
+        std::vector<size_t> sparse;
         const size_t data_hash_code;
         template <class T>
         bool check_type();
         template <class T>
-        std::shared_ptr<std::vector<T>> cast();
+        std::vector<T> *cast();
+        template <class T>
+        ecs::soa::Columns<T> *soa_cast();
+        template <class T, class F>
+        decltype(auto) visit(F f);
+        template <class T>
+        static const Operations *operations();
+        template <class T>
+        static const Operations *soa_operations();
+        template <class V>
+        static void grow(V &vec, size_t n);
+        template <class T>
+        static void move_range(std::vector<T> &vec, size_t count, T *data);
+        template <class T>
+        static void move_range(ecs::soa::Columns<T> &columns, size_t count, T *data);
+        template <class T>
+        static void remove_at(std::vector<T> &vec, size_t i);
+        template <class T>
+        static void remove_at(ecs::soa::Columns<T> &columns, size_t i);
         RegistryNode(size_t hash_code);
 
     public:
@@ -57,30 +175,54 @@ namespace ecs::registry
         {
             Component,
             Resource,
+            Column,
             Unknown,
         } NodeType;
 
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        template <class T>
+        static RegistryNode create(Layout layout = Layout::AoS);
         template <class T>
-        static RegistryNode create();
+        static RegistryNode create_column(Layout layout = Layout::AoS);
         template <class T>
         static RegistryNode create_resource(T &t);
         template <class T>
         static RegistryNode create_resource(T &&t);
         template <class T>
-        void push(T &&t);
+        void push(size_t eid, T &&t);
+        template <class T>
+        void append(T &&t);
+        template <class T>
+        void push_range(const size_t *eids, size_t count, T *data);
+        template <class T>
+        void append_range(size_t count, T *data);
         template <class T>
         T *get(size_t i);
         template <class T>
-        void erase(size_t i);
+        void erase(size_t eid);
         template <class T>
         void set(size_t i, T &&t);
         template <class T>
         size_t size();
         template <class T>
         std::shared_ptr<std::vector<T>> iter();
+        template <class T>
+        ComponentPool<T> pool();
 
         size_t get_hash();
         bool is_resource();
+        Layout get_layout() const;
+        bool contains(size_t eid) const;
+        size_t index_of(size_t eid) const;
+        size_t eid_at(size_t i) const;
+        const std::vector<size_t> &eids() const;
+        void remove(size_t eid);
+        void reserve(size_t n);
+
+        RegistryNode make_column() const;
+        void move_to(size_t i, RegistryNode &dst);
+        void swap_remove(size_t i);
     };
 
     /**
@@ -93,9 +235,61 @@ namespace ecs::registry
     RegistryNode::RegistryNode(size_t hash_code) : data_hash_code(hash_code)
     {
         this->data = nullptr;
+        this->ops = nullptr;
+        this->layout = Layout::AoS;
         this->NodeType = RegistryNode::Type::Unknown;
     }
 
+    /**
+     * @brief Getter function for the type erased operations of T.
+     * 
+     * Safety:
+     *      Each operation uses cast<T> to access the RegistryNode data pointer, thus all
+     *      invariants are upheld.
+     * 
+     * @tparam T - The type associated with the RegistryNode.
+     * @return const RegistryNode::Operations* - The operations for T.
+     */
+    template <class T>
+    const RegistryNode::Operations *RegistryNode::operations()
+    {
+        static const Operations ops = {
+            []() { return RegistryNode::create_column<T>(); },
+            [](RegistryNode &src, size_t i, RegistryNode &dst) {
+                dst.append<T>(std::move((*src.cast<T>())[i]));
+            },
+            [](RegistryNode &node, size_t i) { RegistryNode::remove_at(*node.cast<T>(), i); },
+            [](RegistryNode &node, size_t eid) { node.erase<T>(eid); },
+            [](RegistryNode &node, size_t n) { RegistryNode::grow(*node.cast<T>(), n); },
+        };
+        return &ops;
+    }
+
+    /**
+     * @brief Getter function for the type erased operations of T stored as SoA.
+     * 
+     * Safety:
+     *      Each operation uses soa_cast<T> to access the RegistryNode data pointer, thus
+     *      all invariants are upheld.
+     * 
+     * @tparam T - The type associated with the RegistryNode.
+     * @return const RegistryNode::Operations* - The operations for T.
+     */
+    template <class T>
+    const RegistryNode::Operations *RegistryNode::soa_operations()
+    {
+        static const Operations ops = {
+            []() { return RegistryNode::create_column<T>(Layout::SoA); },
+            [](RegistryNode &src, size_t i, RegistryNode &dst) {
+                dst.append<T>(src.soa_cast<T>()->load(i));
+            },
+            [](RegistryNode &node, size_t i) { RegistryNode::remove_at(*node.soa_cast<T>(), i); },
+            [](RegistryNode &node, size_t eid) { node.erase<T>(eid); },
+            [](RegistryNode &node, size_t n) { RegistryNode::grow(*node.soa_cast<T>(), n); },
+        };
+        return &ops;
+    }
+
     /**
      * @brief A safe constructor of a Component RegistryNode.
      * 
@@ -112,17 +306,61 @@ namespace ecs::registry
      *      
      *      The third invariant is upheld because the data_hash_code is a const member.
      * 
+     *      With Layout::SoA, the data is a pointer to an ecs::soa::Columns<T> instead, 
+     *      and the layout is checked along with the type for every manipulation.
+     * 
      * @tparam T - The type to be associated with the new RegistryNode
+     * @param layout - How the elements are laid out in memory.
      * @return RegistryNode - The RegistryNode associated with the type T.
+     * 
+     * @exception Throws a runtime exception if the layout is SoA, and the fields of T
+     * haven't been declared with ecs::soa::Fields.
      */
     template <class T>
-    RegistryNode RegistryNode::create()
+    RegistryNode RegistryNode::create(Layout layout)
+    {
+        RegistryNode node = RegistryNode::create_column<T>(layout);
+        node.NodeType = RegistryNode::Type::Component;
+        return node;
+    }
+
+    /**
+     * @brief A safe constructor of a Column RegistryNode.
+     * 
+     * Safety:
+     *      The invariants are upheld in the same way as RegistryNode::create<T>(). 
+     * 
+     * @tparam T - The type to be associated with the new RegistryNode
+     * @param layout - How the elements are laid out in memory.
+     * @return RegistryNode - The Column RegistryNode associated with the type T.
+     * 
+     * @exception Throws a runtime exception if the layout is SoA, and the fields of T
+     * haven't been declared with ecs::soa::Fields.
+     */
+    template <class T>
+    RegistryNode RegistryNode::create_column(Layout layout)
     {
         RegistryNode node(typeid(T).hash_code());
 
-        auto v_ptr = std::make_shared<std::vector<T>>();
-        node.data = v_ptr;
-        node.NodeType = RegistryNode::Type::Component;
+        if (layout == Layout::SoA)
+        {
+            if constexpr (ecs::soa::has_fields_v<T>)
+            {
+                node.data = std::make_shared<ecs::soa::Columns<T>>();
+                node.ops = RegistryNode::soa_operations<T>();
+                node.layout = Layout::SoA;
+            }
+            else
+            {
+                throw std::runtime_error("Only components with declared ecs::soa::Fields can be stored as SoA");
+            }
+        }
+        else
+        {
+            node.data = std::make_shared<std::vector<T>>();
+            node.ops = RegistryNode::operations<T>();
+        }
+        node.NodeType = RegistryNode::Type::Column;
         return node;
     }
 
@@ -155,6 +393,7 @@ namespace ecs::registry
 
         auto v_ptr = std::make_shared<std::vector<T>>();
         node.data = v_ptr;
+        node.ops = RegistryNode::operations<T>();
         node.NodeType = RegistryNode::Type::Resource;
         node.cast<T>()->push_back(t);
         return node;
@@ -189,6 +428,7 @@ namespace ecs::registry
 
         auto v_ptr = std::make_shared<std::vector<T>>();
         node.data = v_ptr;
+        node.ops = RegistryNode::operations<T>();
         node.NodeType = RegistryNode::Type::Resource;
         node.cast<T>()->push_back(std::move(t));
         return node;
@@ -226,23 +466,70 @@ namespace ecs::registry
      *      So long as this function is ALWAYS used before accessing the data vector,
      *      then the RegistryNode can be modified and accessed safely.
      * 
+     * The vector is returned as a raw pointer, so that accessing the data doesn't change
+     * the reference count of the shared pointer.
+     * 
      * @tparam T 
-     * @return std::shared_ptr<std::vector<T>> 
+     * @return std::vector<T>*
      */
     template <class T>
-    std::shared_ptr<std::vector<T>> RegistryNode::cast()
+    std::vector<T> *RegistryNode::cast()
     {
         if (!this->check_type<T>())
             throw std::runtime_error("Type doesn't match node");
         if (this->NodeType == RegistryNode::Type::Unknown)
             throw std::runtime_error("RegistryNode formed improperly and has an unknown NodeType");
-        return std::static_pointer_cast<std::vector<T>>(this->data);
+        if (this->layout != Layout::AoS)
+            throw std::runtime_error("Components stored as SoA can't be accessed through a pointer");
+        return static_cast<std::vector<T> *>(this->data.get());
+    }
+
+    /**
+     * @brief The safe accessor function to the data of a RegistryNode stored as SoA.
+     * 
+     * Safety:
+     *      This is the same as cast<T>, but checks that the data is an 
+     *      ecs::soa::Columns<T> rather than a vector<T>.
+     * 
+     * @tparam T 
+     * @return ecs::soa::Columns<T>* 
+     */
+    template <class T>
+    ecs::soa::Columns<T> *RegistryNode::soa_cast()
+    {
+        if (!this->check_type<T>())
+            throw std::runtime_error("Type doesn't match node");
+        if (this->layout != Layout::SoA)
+            throw std::runtime_error("RegistryNode isn't stored as SoA");
+        return static_cast<ecs::soa::Columns<T> *>(this->data.get());
+    }
+
+    /**
+     * @brief Calls a function with the data of the RegistryNode, whichever its layout.
+     * 
+     * The function is given either the vector<T> or the ecs::soa::Columns<T>, so it
+     * must only use what both have in common.
+     * 
+     * @tparam T - The type associated with the RegistryNode.
+     * @tparam F - A callable taking the data by reference.
+     * @param f - The function.
+     * @return decltype(auto) - What the function returns.
+     */
+    template <class T, class F>
+    decltype(auto) RegistryNode::visit(F f)
+    {
+        if constexpr (ecs::soa::has_fields_v<T>)
+        {
+            if (this->layout == Layout::SoA)
+                return f(*this->soa_cast<T>());
+        }
+        return f(*this->cast<T>());
     }
 
     /**
      * @brief A safe function to add a T to the end of the data vector.
      * 
-     * This comsumes t.
+     * This comsumes t. The element is recorded as belonging to the Entity eid.
      * 
      * Safety:
      *      This function uses cast<T> to modify the RegistryNode data pointer, thus all
@@ -252,13 +539,179 @@ namespace ecs::registry
      *      assuring that no elements are added to the resource.
      * 
      * @tparam T - The associated type of this RegistryNode
+     * @param eid - The id of the Entity which owns t
      * @param t - An instance of T
+     * 
+     * @exception Throws a runtime exception if the Entity already has a T.
      */
     template <class T>
-    void RegistryNode::push(T &&t)
+    void RegistryNode::push(size_t eid, T &&t)
     {
-        if (this->NodeType == RegistryNode::Type::Component)
-            this->cast<T>()->push_back(std::move(t));
+        if (this->NodeType != RegistryNode::Type::Component)
+            return;
+        if (this->contains(eid))
+            throw std::runtime_error("Entity already has this component");
+
+        this->visit<T>([&](auto &data) {
+            if (eid >= this->sparse.size())
+                this->sparse.resize(eid + 1, RegistryNode::npos);
+            this->sparse[eid] = data.size();
+            this->entities.push_back(eid);
+            data.push_back(std::move(t));
+        });
+    }
+
+    /**
+     * @brief A safe function to add a T to the end of a Column's data vector.
+     * 
+     * This comsumes t. The owner of t is tracked by the archetype table holding the 
+     * Column.
+     * 
+     * Safety:
+     *      This function uses cast<T> to modify the RegistryNode data pointer, thus all
+     *      invariants are upheld.
+     * 
+     *      This function does nothing unless operating on a Column RegistryNode.
+     * 
+     * @tparam T - The associated type of this RegistryNode
+     * @param t - An instance of T
+     */
+    template <class T>
+    void RegistryNode::append(T &&t)
+    {
+        if (this->NodeType == RegistryNode::Type::Column)
+            this->visit<T>([&t](auto &data) { data.push_back(std::move(t)); });
+    }
+
+    /**
+     * @brief A safe function to add components for a range of Entities.
+     * 
+     * This consumes data[0, count). The Entity with id eids[i] owns data[i].
+     * 
+     * Safety:
+     *      This function uses cast<T> to modify the RegistryNode data pointer, thus all
+     *      invariants are upheld.
+     * 
+     *      This function does nothing unless operating on a Component RegistryNode.
+     * 
+     * @tparam T - The associated type of this RegistryNode
+     * @param eids - The distinct Entity ids of the components.
+     * @param count - The number of components.
+     * @param data - The components.
+     * 
+     * @exception Throws a runtime exception if any of the Entities already have a T.
+     */
+    template <class T>
+    void RegistryNode::push_range(const size_t *eids, size_t count, T *data)
+    {
+        if (this->NodeType != RegistryNode::Type::Component)
+            return;
+        size_t end = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (this->contains(eids[i]))
+                throw std::runtime_error("Entity already has this component");
+            end = std::max(end, eids[i] + 1);
+        }
+
+        this->visit<T>([&](auto &elements) {
+            if (end > this->sparse.size())
+                this->sparse.resize(end, RegistryNode::npos);
+            RegistryNode::grow(this->entities, count);
+            for (size_t i = 0; i < count; i++)
+            {
+                this->sparse[eids[i]] = elements.size() + i;
+                this->entities.push_back(eids[i]);
+            }
+            RegistryNode::move_range(elements, count, data);
+        });
+    }
+
+    /**
+     * @brief A safe function to add a range of T to the end of a Column's data vector.
+     * 
+     * This consumes data[0, count).
+     * 
+     * Safety:
+     *      This function uses cast<T> to modify the RegistryNode data pointer, thus all
+     *      invariants are upheld.
+     * 
+     *      This function does nothing unless operating on a Column RegistryNode.
+     * 
+     * @tparam T - The associated type of this RegistryNode
+     * @param count - The number of components.
+     * @param data - The components.
+     */
+    template <class T>
+    void RegistryNode::append_range(size_t count, T *data)
+    {
+        if (this->NodeType == RegistryNode::Type::Column)
+            this->visit<T>([count, data](auto &elements) { RegistryNode::move_range(elements, count, data); });
+    }
+
+    /**
+     * @brief Moves an array of T to the end of a vector with a single reallocation.
+     * 
+     * Trivially copyable types are copied as one block of memory, which the standard
+     * library does with memmove, rather than being moved one by one.
+     * 
+     * @tparam T - The element type.
+     * @param vec - The vector.
+     * @param count - The number of elements.
+     * @param data - The elements.
+     */
+    template <class T>
+    void RegistryNode::move_range(std::vector<T> &vec, size_t count, T *data)
+    {
+        RegistryNode::grow(vec, count);
+        if constexpr (std::is_trivially_copyable_v<T>)
+            vec.insert(vec.end(), data, data + count);
+        else
+            vec.insert(vec.end(), std::make_move_iterator(data), std::make_move_iterator(data + count));
+    }
+
+    /**
+     * @brief Adds an array of T to the end of the columns with a single reallocation.
+     * 
+     * @tparam T - The element type.
+     * @param columns - The columns.
+     * @param count - The number of elements.
+     * @param data - The elements.
+     */
+    template <class T>
+    void RegistryNode::move_range(ecs::soa::Columns<T> &columns, size_t count, T *data)
+    {
+        RegistryNode::grow(columns, count);
+        for (size_t i = 0; i < count; i++)
+            columns.push_back(data[i]);
+    }
+
+    /**
+     * @brief Removes the ith element by moving the last element into its place.
+     * 
+     * @tparam T - The element type.
+     * @param vec - The vector.
+     * @param i - The index.
+     */
+    template <class T>
+    void RegistryNode::remove_at(std::vector<T> &vec, size_t i)
+    {
+        if (i != vec.size() - 1)
+            vec[i] = std::move(vec.back());
+        vec.pop_back();
+    }
+
+    /**
+     * @brief Removes the ith element by moving the last element into its place.
+     * 
+     * @tparam T - The element type.
+     * @param columns - The columns.
+     * @param i - The index.
+     */
+    template <class T>
+    void RegistryNode::remove_at(ecs::soa::Columns<T> &columns, size_t i)
+    {
+        columns.swap_remove(i);
     }
 
     /**
@@ -282,6 +735,7 @@ namespace ecs::registry
         switch (this->NodeType)
         {
         case RegistryNode::Type::Component:
+        case RegistryNode::Type::Column:
             return &((*this->cast<T>())[i]);
             break;
         case RegistryNode::Type::Resource:
@@ -294,33 +748,44 @@ namespace ecs::registry
     }
 
     /**
-     * @brief A way to remove an element from a Component Registry
+     * @brief A way to remove an Entity's element from a Component Registry
+     * 
+     * Removes the element belonging to the Entity eid from the RegistryNode vector if it
+     * is a Component Type. The last element is moved into the hole left by the removed
+     * element, so removal is constant time.
      * 
-     * Removes the ith element from the RegistryNode vector if it is a Component Type.
      * Note:
-     *      This will affect the indicies of entities who's component id is higher than i
-     *      Because RegistryNodes are unaware of others, this MUST be handled properly
+     *      This changes the index of the last element. Since the sparse entry of the 
+     *      moved element is updated here, looking components up by Entity id stays 
+     *      correct, but indicies obtained before the erase may no longer be valid.
      * 
      * Safety: 
      *      This function uses cast<T> to access the RegistryNode data pointer, thus all 
      *      invariants are upheld.
      * 
-     *      Bounds are NOT checked at this point yet.
+     *      Nothing is done if the Entity doesn't have an element in this RegistryNode.
      * 
      *      Additionally, no operation is done on a RegistryNode of Resource type, thus
      *      upholding the requirement that there is ALWAYS a 0th element in the node.
      * @tparam T - The type to be associated with the new RegistryNode
-     * @param i - The index
+     * @param eid - The id of the Entity who's element is removed.
      */
     template <class T>
-    void RegistryNode::erase(size_t i)
+    void RegistryNode::erase(size_t eid)
     {
-        switch (this->NodeType)
+        if (this->NodeType != RegistryNode::Type::Component || !this->contains(eid))
+            return;
+
+        size_t idx = this->sparse[eid];
+        size_t last = this->entities.size() - 1;
+        this->visit<T>([idx](auto &data) { RegistryNode::remove_at(data, idx); });
+        if (idx != last)
         {
-        case RegistryNode::Type::Component:
-            auto vec_ptr = this->cast<T>();
-            vec_ptr->erase(vec_ptr->begin() + i);
+            this->entities[idx] = this->entities[last];
+            this->sparse[this->entities[idx]] = idx;
         }
+        this->entities.pop_back();
+        this->sparse[eid] = RegistryNode::npos;
     }
 
     /**
@@ -340,6 +805,15 @@ namespace ecs::registry
         switch (this->NodeType)
         {
         case RegistryNode::Type::Component:
+        case RegistryNode::Type::Column:
+            if constexpr (ecs::soa::has_fields_v<T>)
+            {
+                if (this->layout == Layout::SoA)
+                {
+                    this->soa_cast<T>()->store(i, t);
+                    break;
+                }
+            }
             this->cast<T>()->at(i) = std::move(t);
             break;
         case RegistryNode::Type::Resource:
@@ -361,7 +835,7 @@ namespace ecs::registry
     template <class T>
     size_t RegistryNode::size()
     {
-        return this->cast<T>()->size();
+        return this->visit<T>([](auto &data) { return data.size(); });
     }
 
     /**
@@ -375,11 +849,41 @@ namespace ecs::registry
      * 
      * @tparam T - The type to be associated with the new RegistryNode
      * @return std::shared_ptr<std::vector<T>> 
+     * 
+     * @exception Throws a runtime exception if the RegistryNode is stored as SoA.
      */
     template <class T>
     std::shared_ptr<std::vector<T>> RegistryNode::iter()
     {
-        return this->cast<T>();
+        this->cast<T>();
+        return std::static_pointer_cast<std::vector<T>>(this->data);
+    }
+
+    /**
+     * @brief Makes a typed handle to the data of this RegistryNode.
+     * 
+     * The type is checked once here, so the ComponentPool can access the data without
+     * checking it again.
+     * 
+     * Safety:
+     *      This function uses cast<T> to access the RegistryNode data pointer, thus all
+     *      invariants are upheld.
+     * 
+     *      The ComponentPool refers to this RegistryNode, so it must not outlive it or be
+     *      used after the RegistryNode has been moved.
+     * 
+     * @tparam T - The type associated with this RegistryNode
+     * @return ComponentPool<T> 
+     */
+    template <class T>
+    ComponentPool<T> RegistryNode::pool()
+    {
+        if constexpr (ecs::soa::has_fields_v<T>)
+        {
+            if (this->layout == Layout::SoA)
+                return ComponentPool<T>(this->soa_cast<T>(), &this->sparse, this->NodeType);
+        }
+        return ComponentPool<T>(this->cast<T>(), &this->sparse, this->NodeType);
     }
 
     /**
@@ -403,5 +907,444 @@ namespace ecs::registry
         return this->NodeType == RegistryNode::Type::Resource;
     }
 
+    /**
+     * @brief Getter function for how the elements are laid out in memory.
+     * 
+     * @return Layout
+     */
+    Layout RegistryNode::get_layout() const
+    {
+        return this->layout;
+    }
+
+    /**
+     * @brief Checks if an Entity has an element in this RegistryNode.
+     * 
+     * @param eid - The Entity id.
+     * @return true 
+     * @return false 
+     */
+    bool RegistryNode::contains(size_t eid) const
+    {
+        return eid < this->sparse.size() && this->sparse[eid] != RegistryNode::npos;
+    }
+
+    /**
+     * @brief Getter function for the index of an Entity's element.
+     * 
+     * @param eid - The Entity id.
+     * @return size_t - The index of the element, or RegistryNode::npos if the Entity
+     * doesn't have an element in this RegistryNode.
+     */
+    size_t RegistryNode::index_of(size_t eid) const
+    {
+        return this->contains(eid) ? this->sparse[eid] : RegistryNode::npos;
+    }
+
+    /**
+     * @brief Getter function for the id of the Entity owning the ith element.
+     * 
+     * @param i - The index.
+     * @return size_t - The Entity id.
+     */
+    size_t RegistryNode::eid_at(size_t i) const
+    {
+        return this->entities.at(i);
+    }
+
+    /**
+     * @brief Getter function for the ids of the Entities owning the elements, in order.
+     * 
+     * @return const std::vector<size_t>&
+     */
+    const std::vector<size_t> &RegistryNode::eids() const
+    {
+        return this->entities;
+    }
+
+    /**
+     * @brief Removes an Entity's element without knowing the type of the RegistryNode.
+     * 
+     * This behaves the same as erase<T>(eid).
+     * 
+     * @param eid - The id of the Entity who's element is removed.
+     */
+    void RegistryNode::remove(size_t eid)
+    {
+        if (this->NodeType != RegistryNode::Type::Component || !this->contains(eid))
+            return;
+        this->ops->erase(*this, eid);
+    }
+
+    /**
+     * @brief Makes room for n more elements, so they can be added without reallocating.
+     * 
+     * This does nothing for a Resource RegistryNode.
+     * 
+     * @param n - The number of elements about to be added.
+     */
+    void RegistryNode::reserve(size_t n)
+    {
+        if (this->NodeType == RegistryNode::Type::Component)
+            RegistryNode::grow(this->entities, n);
+        else if (this->NodeType != RegistryNode::Type::Column)
+            return;
+        if (this->ops == nullptr)
+            throw std::runtime_error("RegistryNode formed improperly and has no operations");
+        this->ops->reserve(*this, n);
+    }
+
+    /**
+     * @brief Grows the capacity of a vector to fit n more elements.
+     * 
+     * The capacity is at least doubled, so that reserving for many small batches still
+     * only reallocates a logarithmic number of times.
+     * 
+     * @tparam V - The vector type.
+     * @param vec - The vector.
+     * @param n - The number of elements about to be added.
+     */
+    template <class V>
+    void RegistryNode::grow(V &vec, size_t n)
+    {
+        if (vec.size() + n > vec.capacity())
+            vec.reserve(std::max(vec.size() + n, vec.capacity() * 2));
+    }
+
+    /**
+     * @brief Creates an empty Column RegistryNode of the same type as this RegistryNode.
+     * 
+     * @return RegistryNode - The new Column.
+     */
+    RegistryNode RegistryNode::make_column() const
+    {
+        if (this->ops == nullptr)
+            throw std::runtime_error("RegistryNode formed improperly and has no operations");
+        return this->ops->create_column();
+    }
+
+    /**
+     * @brief Moves the ith element of this Column to the end of another Column.
+     * 
+     * The moved-from element is left in place, and should be removed with swap_remove().
+     * 
+     * Safety:
+     *      The Columns must have the same type. This is checked by the cast<T> done by
+     *      the operation.
+     * 
+     * @param i - The index of the element to move.
+     * @param dst - The Column to move the element to.
+     */
+    void RegistryNode::move_to(size_t i, RegistryNode &dst)
+    {
+        if (this->NodeType != RegistryNode::Type::Column || dst.NodeType != RegistryNode::Type::Column)
+            throw std::runtime_error("Can only move elements between Column RegistryNodes");
+        this->ops->move_to(*this, i, dst);
+    }
+
+    /**
+     * @brief Removes the ith element of a Column by swapping it with the last element.
+     * 
+     * @param i - The index of the element to remove.
+     */
+    void RegistryNode::swap_remove(size_t i)
+    {
+        if (this->NodeType != RegistryNode::Type::Column)
+            throw std::runtime_error("Can only swap_remove from a Column RegistryNode");
+        this->ops->swap_remove(*this, i);
+    }
+
+    /**
+     * @brief The state a ComponentPool needs for elements stored as SoA.
+     * 
+     * Types without declared ecs::soa::Fields can't be stored as SoA, so their pools 
+     * carry no extra state, and stay as cheap to copy as a pair of pointers.
+     * 
+     * @tparam T - The type associated with the RegistryNode.
+     */
+    template <class T, bool = ecs::soa::has_fields_v<T>>
+    class PoolCache
+    {
+    };
+
+    /**
+     * @brief The columns of a pool stored as SoA, and the element loaded from them.
+     * 
+     * @tparam T - The type associated with the RegistryNode.
+     */
+    template <class T>
+    class PoolCache<T, true>
+    {
+    protected:
+        ecs::soa::Columns<T> *soa_ptr;
+        T scratch;
+        size_t loaded;
+
+        PoolCache(ecs::soa::Columns<T> *columns = nullptr) : soa_ptr(columns), scratch(), loaded(RegistryNode::npos) {}
+        PoolCache(const PoolCache &other);
+        PoolCache &operator=(const PoolCache &other);
+        ~PoolCache();
+
+        void flush();
+    };
+
+    /**
+     * @brief Copies the columns. An element loaded by the other pool isn't copied.
+     * 
+     * @param other - The PoolCache to copy.
+     */
+    template <class T>
+    PoolCache<T, true>::PoolCache(const PoolCache &other) : soa_ptr(other.soa_ptr), scratch(), loaded(RegistryNode::npos)
+    {
+    }
+
+    /**
+     * @brief Writes back the loaded element, and copies the columns.
+     * 
+     * @param other - The PoolCache to copy.
+     * @return PoolCache<T, true>& - This PoolCache.
+     */
+    template <class T>
+    PoolCache<T, true> &PoolCache<T, true>::operator=(const PoolCache &other)
+    {
+        if (this == &other)
+            return *this;
+        this->flush();
+        this->soa_ptr = other.soa_ptr;
+        return *this;
+    }
+
+    /**
+     * @brief Writes back the loaded element.
+     * 
+     */
+    template <class T>
+    PoolCache<T, true>::~PoolCache()
+    {
+        this->flush();
+    }
+
+    /**
+     * @brief Writes the loaded element back to its columns.
+     * 
+     * Only the fields which changed are written.
+     * 
+     */
+    template <class T>
+    void PoolCache<T, true>::flush()
+    {
+        if (this->loaded != RegistryNode::npos && this->loaded < this->soa_ptr->size())
+            this->soa_ptr->update(this->loaded, this->scratch);
+        this->loaded = RegistryNode::npos;
+    }
+
+    /**
+     * @brief A typed handle to the data of a RegistryNode, for use in hot loops.
+     * 
+     * Accessing a RegistryNode checks the type of the data on every call. A 
+     * ComponentPool is made with RegistryNode::pool<T>(), which checks the type once,
+     * and then accesses the data vector directly. 
+     * 
+     * Bounds and membership are only checked with assert, so they are checked in debug
+     * builds and cost nothing when NDEBUG is defined.
+     * 
+     * Components stored as SoA have no address, so the ComponentPool loads the element
+     * being accessed into a copy held by the pool, and returns a pointer to the copy.
+     * The copy is written back when the next element is accessed, or when the pool is
+     * destroyed, and only the fields which changed are written. A pointer into a SoA 
+     * pool is therefore only valid until the next access through the same pool.
+     * 
+     * Safety:
+     *      The ComponentPool refers to the data and sparse vectors of its RegistryNode.
+     *      Indices and element pointers are invalidated by anything which adds or removes
+     *      elements, in the same way as for the RegistryNode itself.
+     * 
+     * @tparam T - The type associated with the RegistryNode.
+     */
+    template <class T>
+    class ComponentPool : public PoolCache<T>
+    {
+    private:
+        std::vector<T> *vec_ptr;
+        const std::vector<size_t> *sparse_ptr;
+        RegistryNode::Type type;
+
+    public:
+        ComponentPool() : vec_ptr(nullptr), sparse_ptr(nullptr), type(RegistryNode::Type::Unknown) {}
+        ComponentPool(std::vector<T> *vec, const std::vector<size_t> *sparse, RegistryNode::Type node_type)
+            : vec_ptr(vec), sparse_ptr(sparse), type(node_type) {}
+        ComponentPool(ecs::soa::Columns<T> *columns, const std::vector<size_t> *sparse, RegistryNode::Type node_type)
+            : PoolCache<T>(columns), vec_ptr(nullptr), sparse_ptr(sparse), type(node_type) {}
+        ~ComponentPool() = default;
+
+        size_t size() const;
+        T *data();
+        ecs::soa::Columns<T> *columns();
+        T *get(size_t i);
+        T *find(size_t eid);
+        T *fetch(size_t row, size_t eid);
+        void flush();
+    };
+
+    /**
+     * @brief Getter function for the number of elements.
+     * 
+     * @return size_t 
+     */
+    template <class T>
+    size_t ComponentPool<T>::size() const
+    {
+        if constexpr (ecs::soa::has_fields_v<T>)
+        {
+            if (this->soa_ptr != nullptr)
+                return this->soa_ptr->size();
+        }
+        return this->vec_ptr->size();
+    }
+
+    /**
+     * @brief Getter function for the contiguous elements.
+     * 
+     * @return T* - A pointer to the first element, or nullptr if the elements are 
+     *              stored as SoA.
+     */
+    template <class T>
+    T *ComponentPool<T>::data()
+    {
+        if (this->vec_ptr == nullptr)
+            return nullptr;
+        return this->vec_ptr->data();
+    }
+
+    /**
+     * @brief Getter function for the columns of elements stored as SoA.
+     * 
+     * Writes back the loaded element first, so the columns are up to date.
+     * 
+     * @return ecs::soa::Columns<T>* - The columns, or nullptr if the elements are
+     *                                 stored as AoS.
+     */
+    template <class T>
+    ecs::soa::Columns<T> *ComponentPool<T>::columns()
+    {
+        if constexpr (ecs::soa::has_fields_v<T>)
+        {
+            this->flush();
+            return this->soa_ptr;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Accessor to the ith element. A resource always returns its one element.
+     * 
+     * @param i - The index.
+     * @return T* 
+     */
+    template <class T>
+    T *ComponentPool<T>::get(size_t i)
+    {
+        if constexpr (ecs::soa::has_fields_v<T>)
+        {
+            if (this->soa_ptr != nullptr)
+            {
+                assert(i < this->soa_ptr->size());
+                if (i != this->loaded)
+                {
+                    this->flush();
+                    this->scratch = this->soa_ptr->load(i);
+                    this->loaded = i;
+                }
+                return &this->scratch;
+            }
+        }
+        if (this->type == RegistryNode::Type::Resource)
+            return this->vec_ptr->data();
+        assert(i < this->vec_ptr->size());
+        return this->vec_ptr->data() + i;
+    }
+
+    /**
+     * @brief Accessor to the element of an Entity in a Component RegistryNode.
+     * 
+     * The Entity MUST have an element. A resource always returns its one element.
+     * 
+     * @param eid - The Entity id.
+     * @return T* 
+     */
+    template <class T>
+    T *ComponentPool<T>::find(size_t eid)
+    {
+        if (this->type == RegistryNode::Type::Resource)
+            return this->get(0);
+        assert(this->type == RegistryNode::Type::Component);
+        assert(eid < this->sparse_ptr->size() && (*this->sparse_ptr)[eid] != RegistryNode::npos);
+        return this->get((*this->sparse_ptr)[eid]);
+    }
+
+    /**
+     * @brief Accessor to the element of an Entity stored in a row of an archetype table.
+     * 
+     * Columns are indexed by the row, Component RegistryNodes are looked up by the 
+     * Entity id, and resources always return their one element.
+     * 
+     * @param row - The row of the Entity.
+     * @param eid - The Entity id.
+     * @return T* 
+     */
+    template <class T>
+    T *ComponentPool<T>::fetch(size_t row, size_t eid)
+    {
+        if (this->type == RegistryNode::Type::Column)
+            return this->get(row);
+        return this->find(eid);
+    }
+
+    /**
+     * @brief Writes the loaded element of a SoA pool back to its columns.
+     * 
+     * This does nothing for elements stored as AoS, which are accessed in place.
+     * 
+     */
+    template <class T>
+    void ComponentPool<T>::flush()
+    {
+        if constexpr (ecs::soa::has_fields_v<T>)
+            PoolCache<T>::flush();
+    }
+
+    /**
+     * @brief A reference to a single component, whichever way it's stored.
+     * 
+     * A ComponentRef behaves like a T*, which may be null. For a component stored as 
+     * SoA, the pointer is to a copy held by the ComponentRef, and the changed fields are
+     * written back when the ComponentRef is destroyed. So it can't be copied or moved,
+     * and the pointer must not be kept after the ComponentRef is gone.
+     * 
+     * @tparam T - The component type.
+     */
+    template <class T>
+    class ComponentRef
+    {
+    private:
+        ComponentPool<T> pool;
+        T *ptr;
+
+    public:
+        ComponentRef() : pool(), ptr(nullptr) {}
+        ComponentRef(const ComponentPool<T> &pool, size_t i) : pool(pool), ptr(nullptr)
+        {
+            this->ptr = this->pool.get(i);
+        }
+        ComponentRef(const ComponentRef &) = delete;
+        ComponentRef &operator=(const ComponentRef &) = delete;
+        ~ComponentRef() = default;
+
+        T *get() const { return this->ptr; }
+        T *operator->() const { return this->ptr; }
+        T &operator*() const { return *this->ptr; }
+        explicit operator bool() const { return this->ptr != nullptr; }
+    };
+
 } // namespace ecs::registry
 #endif
\ No newline at end of file
@@ -0,0 +1,368 @@
+#ifndef ecs_soa_hpp
+#define ecs_soa_hpp
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The alignment in bytes of every column of a component stored as SoA.
+ * 
+ * This is a cache line by default, which is enough for any vector load. This can be
+ * defined before including the ecs headers.
+ */
+#ifndef ECS_SOA_ALIGNMENT
+#define ECS_SOA_ALIGNMENT 64
+#endif
+
+namespace ecs::soa
+{
+    /**
+     * @brief A list of the data members of a component.
+     * 
+     * Used to declare the fields of a component, see ecs::soa::Fields.
+     * 
+     * @tparam Members - Pointers to the data members, e.g. &Position::x, &Position::y.
+     */
+    template <auto... Members>
+    struct FieldList
+    {
+        static constexpr auto members = std::make_tuple(Members...);
+    };
+
+    /**
+     * @brief Declares the fields of a component, so it can be stored as a struct of arrays.
+     * 
+     * A component is only stored one column per field if its fields have been declared,
+     * by specializing Fields to inherit a FieldList of every data member:
+     * 
+     * ```cpp
+     * struct Position
+     * {
+     *     float x;
+     *     float y;
+     * };
+     * 
+     * template <>
+     * struct ecs::soa::Fields<Position> : ecs::soa::FieldList<&Position::x, &Position::y>
+     * {
+     * };
+     * ```
+     * 
+     * @tparam T - The component.
+     */
+    template <class T>
+    struct Fields
+    {
+    };
+
+    /**
+     * @brief Checks if the fields of T have been declared with ecs::soa::Fields.
+     * 
+     * @tparam T - The component.
+     */
+    template <class T, class = void>
+    struct has_fields : std::false_type
+    {
+    };
+
+    template <class T>
+    struct has_fields<T, std::void_t<decltype(Fields<T>::members)>> : std::true_type
+    {
+    };
+
+    template <class T>
+    inline constexpr bool has_fields_v = has_fields<T>::value;
+
+    /**
+     * @brief The type of a data member, from a pointer to it.
+     * 
+     * @tparam M - The pointer to data member type.
+     */
+    template <class M>
+    struct member_type;
+
+    template <class C, class F>
+    struct member_type<F C::*>
+    {
+        using type = F;
+    };
+
+    /**
+     * @brief An allocator which aligns every allocation to Align bytes.
+     * 
+     * @tparam V - The allocated type.
+     * @tparam Align - The alignment in bytes.
+     */
+    template <class V, size_t Align>
+    struct AlignedAllocator
+    {
+        using value_type = V;
+
+        template <class U>
+        struct rebind
+        {
+            using other = AlignedAllocator<U, Align>;
+        };
+
+        AlignedAllocator() = default;
+        template <class U>
+        AlignedAllocator(const AlignedAllocator<U, Align> &) {}
+
+        V *allocate(size_t n)
+        {
+            return static_cast<V *>(::operator new(n * sizeof(V), std::align_val_t(Align)));
+        }
+
+        void deallocate(V *p, size_t)
+        {
+            ::operator delete(p, std::align_val_t(Align));
+        }
+
+        template <class U>
+        bool operator==(const AlignedAllocator<U, Align> &) const { return true; }
+        template <class U>
+        bool operator!=(const AlignedAllocator<U, Align> &) const { return false; }
+    };
+
+    /**
+     * @brief The components of a type stored as a struct of arrays.
+     * 
+     * Each field declared by ecs::soa::Fields<T> is kept in its own column, which is
+     * aligned to ECS_SOA_ALIGNMENT bytes. The ith element of every column belongs to the
+     * ith component. A loop over one field only loads that field, and a loop over a few
+     * columns can be vectorized with aligned loads.
+     * 
+     * As the fields of a component aren't next to each other, a component can't be
+     * accessed through a pointer. Components are copied out with load() and written back
+     * with store() or update().
+     * 
+     * Every byte of T must belong to a declared field, so T can be rebuilt from its
+     * columns. This holds for plain numeric components like a position or a velocity.
+     * 
+     * @tparam T - The component type.
+     */
+    template <class T>
+    class Columns
+    {
+    private:
+        template <class Tuple>
+        struct column_types;
+
+        template <class... Ms>
+        struct column_types<std::tuple<Ms...>>
+        {
+            using type = std::tuple<std::vector<typename member_type<Ms>::type, AlignedAllocator<typename member_type<Ms>::type, ECS_SOA_ALIGNMENT>>...>;
+            static constexpr size_t field_bytes = (sizeof(typename member_type<Ms>::type) + ... + 0);
+        };
+
+        using members_t = std::remove_const_t<decltype(Fields<T>::members)>;
+        using columns_t = typename column_types<members_t>::type;
+
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable components can be stored as SoA");
+        static_assert(std::is_default_constructible_v<T>, "Only default constructible components can be stored as SoA");
+        static_assert(column_types<members_t>::field_bytes == sizeof(T), "Every field of a component stored as SoA must be declared in ecs::soa::Fields");
+
+        columns_t columns;
+
+        template <size_t... Is>
+        void push_back(const T &t, std::index_sequence<Is...>);
+        template <size_t... Is>
+        T load(size_t i, std::index_sequence<Is...>) const;
+        template <size_t... Is>
+        void update(size_t i, const T &t, std::index_sequence<Is...>);
+
+    public:
+        static constexpr size_t n_fields = std::tuple_size_v<members_t>;
+        using indices = std::make_index_sequence<n_fields>;
+
+        Columns() = default;
+        ~Columns() = default;
+
+        size_t size() const;
+        size_t capacity() const;
+        void reserve(size_t n);
+        void push_back(const T &t);
+        void pop_back();
+        T load(size_t i) const;
+        void store(size_t i, const T &t);
+        void update(size_t i, const T &t);
+        void swap_remove(size_t i);
+
+        template <size_t F>
+        auto *column();
+        template <size_t F>
+        const auto *column() const;
+    };
+
+    /**
+     * @brief Getter function for the number of components.
+     * 
+     * @return size_t
+     */
+    template <class T>
+    size_t Columns<T>::size() const
+    {
+        return std::get<0>(this->columns).size();
+    }
+
+    /**
+     * @brief Getter function for the number of components which fit without reallocating.
+     * 
+     * @return size_t
+     */
+    template <class T>
+    size_t Columns<T>::capacity() const
+    {
+        return std::get<0>(this->columns).capacity();
+    }
+
+    /**
+     * @brief Makes room for n components in every column.
+     * 
+     * @param n - The number of components.
+     */
+    template <class T>
+    void Columns<T>::reserve(size_t n)
+    {
+        std::apply([n](auto &... column) { (column.reserve(n), ...); }, this->columns);
+    }
+
+    /**
+     * @brief Adds a component to the end of the columns.
+     * 
+     * @param t - The component.
+     */
+    template <class T>
+    void Columns<T>::push_back(const T &t)
+    {
+        this->push_back(t, indices());
+    }
+
+    template <class T>
+    template <size_t... Is>
+    void Columns<T>::push_back(const T &t, std::index_sequence<Is...>)
+    {
+        (std::get<Is>(this->columns).push_back(t.*std::get<Is>(Fields<T>::members)), ...);
+    }
+
+    /**
+     * @brief Removes the last component.
+     * 
+     */
+    template <class T>
+    void Columns<T>::pop_back()
+    {
+        std::apply([](auto &... column) { (column.pop_back(), ...); }, this->columns);
+    }
+
+    /**
+     * @brief Copies the ith component out of the columns.
+     * 
+     * @param i - The index.
+     * @return T - A copy of the component.
+     */
+    template <class T>
+    T Columns<T>::load(size_t i) const
+    {
+        return this->load(i, indices());
+    }
+
+    template <class T>
+    template <size_t... Is>
+    T Columns<T>::load(size_t i, std::index_sequence<Is...>) const
+    {
+        T t;
+        ((t.*std::get<Is>(Fields<T>::members) = std::get<Is>(this->columns)[i]), ...);
+        return t;
+    }
+
+    /**
+     * @brief Overwrites every field of the ith component.
+     * 
+     * @param i - The index.
+     * @param t - The new value of the component.
+     * 
+     * @exception Throws a runtime exception if there is no ith component.
+     */
+    template <class T>
+    void Columns<T>::store(size_t i, const T &t)
+    {
+        if (i >= this->size())
+            throw std::runtime_error("Index out of range of the columns");
+        this->update(i, t);
+    }
+
+    /**
+     * @brief Writes only the fields of the ith component which differ from t.
+     * 
+     * Fields are compared by their bytes. A component which is loaded and not changed
+     * is never written, so threads which only read a component can load it at the same
+     * time.
+     * 
+     * @param i - The index.
+     * @param t - The new value of the component.
+     */
+    template <class T>
+    void Columns<T>::update(size_t i, const T &t)
+    {
+        this->update(i, t, indices());
+    }
+
+    template <class T>
+    template <size_t... Is>
+    void Columns<T>::update(size_t i, const T &t, std::index_sequence<Is...>)
+    {
+        auto write = [i](auto &column, const auto &value) {
+            if (std::memcmp(&column[i], &value, sizeof(value)) != 0)
+                column[i] = value;
+        };
+        (write(std::get<Is>(this->columns), t.*std::get<Is>(Fields<T>::members)), ...);
+    }
+
+    /**
+     * @brief Removes the ith component by moving the last component into its place.
+     * 
+     * @param i - The index.
+     */
+    template <class T>
+    void Columns<T>::swap_remove(size_t i)
+    {
+        std::apply([i](auto &... column) { ((column[i] = column.back(), column.pop_back()), ...); }, this->columns);
+    }
+
+    /**
+     * @brief Getter function for the Fth column.
+     * 
+     * The column holds size() elements, and starts on an ECS_SOA_ALIGNMENT byte boundary.
+     * 
+     * @tparam F - The index of the field, in the order of ecs::soa::Fields<T>.
+     * @return auto* - A pointer to the first element of the column.
+     */
+    template <class T>
+    template <size_t F>
+    auto *Columns<T>::column()
+    {
+        return std::get<F>(this->columns).data();
+    }
+
+    /**
+     * @brief Getter function for the Fth column.
+     * 
+     * @tparam F - The index of the field, in the order of ecs::soa::Fields<T>.
+     * @return const auto* - A pointer to the first element of the column.
+     */
+    template <class T>
+    template <size_t F>
+    const auto *Columns<T>::column() const
+    {
+        return std::get<F>(this->columns).data();
+    }
+
+} // namespace ecs::soa
+
+#endif
@@ -0,0 +1,466 @@
+#ifndef ecs_spatial_hpp
+#define ecs_spatial_hpp
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <ecs/entity.hpp>
+
+namespace ecs::spatial
+{
+    using ecs::entity::EntityHandle;
+
+    /**
+     * @brief An axis aligned bounding box.
+     * 
+     * Boxes which only touch along an edge don't overlap.
+     * 
+     */
+    struct AABB
+    {
+        float min_x;
+        float min_y;
+        float max_x;
+        float max_y;
+
+        bool overlaps(const AABB &other) const
+        {
+            return this->min_x < other.max_x && other.min_x < this->max_x &&
+                   this->min_y < other.max_y && other.min_y < this->max_y;
+        }
+    };
+
+    AABB swept(const AABB &box, float dx, float dy);
+    float time_of_impact(const AABB &moving, float dx, float dy, const AABB &target);
+
+    /**
+     * @brief Finds the box covered by a box as it moves in a straight line.
+     * 
+     * @param box - The box before it moves.
+     * @param dx - How far the box moves in the x direction.
+     * @param dy - How far the box moves in the y direction.
+     * @return AABB - The smallest box which holds the box before and after it moves.
+     */
+    AABB swept(const AABB &box, float dx, float dy)
+    {
+        return {std::min(box.min_x, box.min_x + dx), std::min(box.min_y, box.min_y + dy),
+                std::max(box.max_x, box.max_x + dx), std::max(box.max_y, box.max_y + dy)};
+    }
+
+    /**
+     * @brief Finds when a moving box first overlaps a box which isn't moving.
+     * 
+     * The moving box travels from where it is at time 0 to (dx, dy) further at time 1.
+     * The time is found in closed form, from when the box enters and leaves the target
+     * along each axis, so a box which moves through the target between time 0 and 1 is
+     * still found.
+     * 
+     * A negative time means the boxes already overlap at time 0, and is when they would
+     * have started to overlap had the box always been moving the same way. Moving the
+     * box to that time separates them again.
+     * 
+     * @param moving - The moving box, at time 0.
+     * @param dx - How far the box moves in the x direction by time 1.
+     * @param dy - How far the box moves in the y direction by time 1.
+     * @param target - The box which isn't moving.
+     * @return float - The time of impact, at most 1. Infinity if the boxes don't overlap
+     *                 between time 0 and 1, and negative infinity if they overlap but the
+     *                 box isn't moving.
+     */
+    float time_of_impact(const AABB &moving, float dx, float dy, const AABB &target)
+    {
+        const float inf = std::numeric_limits<float>::infinity();
+        float enter = -inf;
+        float exit = inf;
+
+        auto axis = [&](float min, float max, float target_min, float target_max, float d) {
+            if (d == 0)
+            {
+                if (max <= target_min || target_max <= min)
+                    exit = -inf;
+                return;
+            }
+            float t0 = (target_min - max) / d;
+            float t1 = (target_max - min) / d;
+            enter = std::max(enter, std::min(t0, t1));
+            exit = std::min(exit, std::max(t0, t1));
+        };
+        axis(moving.min_x, moving.max_x, target.min_x, target.max_x, dx);
+        axis(moving.min_y, moving.max_y, target.min_y, target.max_y, dy);
+
+        if (enter >= exit || enter >= 1 || exit <= 0)
+            return inf;
+        return enter;
+    }
+
+    /**
+     * @brief A uniform grid of Entity bounding boxes, for finding which Entities overlap.
+     * 
+     * The plane is split into square cells, and each Entity is listed in every cell its
+     * box covers. Only the cells covered by a query are searched, so finding what
+     * overlaps a box costs about as much as the number of Entities near it, rather than
+     * the number of Entities in the World. The cells are hashed, so the plane has no
+     * bounds and empty cells take no memory.
+     * 
+     * The grid is kept up to date incrementally: UniformGrid::update() only moves an
+     * Entity between cells when the range of cells its box covers changes. The grid is
+     * meant to be used as a resource. A System which writes it keeps the boxes up to
+     * date, and Systems which read it find overlaps.
+     * 
+     * An Entity which covers many cells is still only reported once by a query, since it
+     * is only reported from the first cell shared by its box and the query.
+     * 
+     */
+    class UniformGrid
+    {
+    private:
+        struct CellRange
+        {
+            int32_t x0, y0, x1, y1;
+
+            bool operator==(const CellRange &other) const { return x0 == other.x0 && y0 == other.y0 && x1 == other.x1 && y1 == other.y1; }
+        };
+
+        struct Entry
+        {
+            EntityHandle handle;
+            AABB box;
+            CellRange range;
+            bool present;
+            std::vector<size_t> slots; // Where the Entity is in each cell of its range.
+        };
+
+        struct Cell
+        {
+            int32_t x;
+            int32_t y;
+            std::vector<size_t> eids;
+        };
+
+        float cell_size;
+        float inv_cell_size;
+        std::vector<Entry> entries;
+        std::unordered_map<uint64_t, Cell> cells;
+        size_t n_entries;
+
+        static uint64_t key(int32_t x, int32_t y);
+        int32_t cell_of(float v) const;
+        CellRange range_of(const AABB &box) const;
+        static size_t slot_of(const CellRange &range, int32_t x, int32_t y);
+        void link(size_t eid, const CellRange &range);
+        void unlink(size_t eid);
+
+    public:
+        UniformGrid(float cell_size);
+        ~UniformGrid() = default;
+
+        void update(EntityHandle handle, const AABB &box);
+        void erase(EntityHandle handle);
+        bool contains(EntityHandle handle) const;
+        size_t size() const;
+        void clear();
+
+        template <class F>
+        void query_aabb(const AABB &box, F f) const;
+        std::vector<EntityHandle> query_aabb(const AABB &box) const;
+        template <class F>
+        void for_each_pair(F f) const;
+    };
+
+    /**
+     * @brief Construct a new UniformGrid object without any Entities.
+     * 
+     * The cells should be about the size of the typical box. Much smaller cells list each
+     * Entity in many cells, and much larger cells put many Entities which don't overlap
+     * in the same cell.
+     * 
+     * @param cell_size - The width and height of each cell.
+     * 
+     * @exception Throws a runtime exception if cell_size isn't positive.
+     */
+    UniformGrid::UniformGrid(float cell_size) : cell_size(cell_size), inv_cell_size(1.0f / cell_size), n_entries(0)
+    {
+        if (!(cell_size > 0))
+            throw std::runtime_error("The cells of a UniformGrid must have a positive size");
+    }
+
+    /**
+     * @brief Packs the coordinates of a cell into the key of its hash map entry.
+     * 
+     * @param x
+     * @param y
+     * @return uint64_t
+     */
+    uint64_t UniformGrid::key(int32_t x, int32_t y)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+    }
+
+    /**
+     * @brief Finds the cell coordinate of a point along one axis.
+     * 
+     * @param v - The coordinate of the point.
+     * @return int32_t
+     */
+    int32_t UniformGrid::cell_of(float v) const
+    {
+        return static_cast<int32_t>(std::floor(v * this->inv_cell_size));
+    }
+
+    /**
+     * @brief Finds the cells covered by a box.
+     * 
+     * @param box
+     * @return CellRange - The inclusive range of cells.
+     */
+    UniformGrid::CellRange UniformGrid::range_of(const AABB &box) const
+    {
+        return {this->cell_of(box.min_x), this->cell_of(box.min_y), this->cell_of(box.max_x), this->cell_of(box.max_y)};
+    }
+
+    /**
+     * @brief Finds which of an Entity's slots belongs to a cell in its range.
+     * 
+     * @param range - The range of cells covered by the Entity.
+     * @param x - The x coordinate of the cell.
+     * @param y - The y coordinate of the cell.
+     * @return size_t - The index into Entry::slots.
+     */
+    size_t UniformGrid::slot_of(const CellRange &range, int32_t x, int32_t y)
+    {
+        return static_cast<size_t>(x - range.x0) * static_cast<size_t>(range.y1 - range.y0 + 1) + static_cast<size_t>(y - range.y0);
+    }
+
+    /**
+     * @brief Lists an Entity in a range of cells.
+     * 
+     * @param eid - The Entity id.
+     * @param range - The range of cells.
+     */
+    void UniformGrid::link(size_t eid, const CellRange &range)
+    {
+        auto &slots = this->entries[eid].slots;
+        slots.clear();
+        for (int32_t x = range.x0; x <= range.x1; x++)
+        {
+            for (int32_t y = range.y0; y <= range.y1; y++)
+            {
+                Cell &cell = this->cells[UniformGrid::key(x, y)];
+                cell.x = x;
+                cell.y = y;
+                slots.push_back(cell.eids.size());
+                cell.eids.push_back(eid);
+            }
+        }
+    }
+
+    /**
+     * @brief Removes an Entity from the cells of its range. Cells which become empty are freed.
+     * 
+     * The slots of the Entity are used to find it in each cell in constant time, and the
+     * last Entity of the cell is moved into its place.
+     * 
+     * @param eid - The Entity id.
+     */
+    void UniformGrid::unlink(size_t eid)
+    {
+        const Entry &entry = this->entries[eid];
+        for (int32_t x = entry.range.x0; x <= entry.range.x1; x++)
+        {
+            for (int32_t y = entry.range.y0; y <= entry.range.y1; y++)
+            {
+                auto it = this->cells.find(UniformGrid::key(x, y));
+                auto &eids = it->second.eids;
+                size_t slot = entry.slots[UniformGrid::slot_of(entry.range, x, y)];
+                size_t moved = eids.back();
+                eids[slot] = moved;
+                eids.pop_back();
+                if (moved != eid)
+                {
+                    Entry &other = this->entries[moved];
+                    other.slots[UniformGrid::slot_of(other.range, x, y)] = slot;
+                }
+                if (eids.empty())
+                    this->cells.erase(it);
+            }
+        }
+    }
+
+    /**
+     * @brief Sets the box of an Entity, adding the Entity if it isn't in the grid.
+     * 
+     * If the Entity id is held by an older Entity which was never erased, the older
+     * Entity is replaced.
+     * 
+     * @param handle - The handle of the Entity.
+     * @param box - The bounding box of the Entity.
+     */
+    void UniformGrid::update(EntityHandle handle, const AABB &box)
+    {
+        size_t eid = handle.index;
+        if (eid >= this->entries.size())
+            this->entries.resize(eid + 1, Entry{{0, 0}, {0, 0, 0, 0}, {0, 0, -1, -1}, false, {}});
+
+        Entry &entry = this->entries[eid];
+        CellRange range = this->range_of(box);
+        if (!entry.present)
+        {
+            this->link(eid, range);
+            this->n_entries++;
+        }
+        else if (!(entry.range == range))
+        {
+            this->unlink(eid);
+            this->link(eid, range);
+        }
+        entry.handle = handle;
+        entry.box = box;
+        entry.range = range;
+        entry.present = true;
+    }
+
+    /**
+     * @brief Removes an Entity from the grid. Nothing is done if it isn't in the grid.
+     * 
+     * @param handle - The handle of the Entity.
+     */
+    void UniformGrid::erase(EntityHandle handle)
+    {
+        if (!this->contains(handle))
+            return;
+        this->unlink(handle.index);
+        this->entries[handle.index].present = false;
+        this->n_entries--;
+    }
+
+    /**
+     * @brief Checks if an Entity is in the grid.
+     * 
+     * @param handle - The handle of the Entity.
+     * @return true
+     * @return false
+     */
+    bool UniformGrid::contains(EntityHandle handle) const
+    {
+        return handle.index < this->entries.size() && this->entries[handle.index].present &&
+               this->entries[handle.index].handle == handle;
+    }
+
+    /**
+     * @brief Getter function for the number of Entities in the grid.
+     * 
+     * @return size_t
+     */
+    size_t UniformGrid::size() const
+    {
+        return this->n_entries;
+    }
+
+    /**
+     * @brief Removes every Entity from the grid.
+     * 
+     */
+    void UniformGrid::clear()
+    {
+        this->entries.clear();
+        this->cells.clear();
+        this->n_entries = 0;
+    }
+
+    /**
+     * @brief Calls a function for each Entity whose box overlaps a box.
+     * 
+     * When the box covers more cells than are in use, the cells in use are searched
+     * instead, so a very large query is never slower than searching every Entity.
+     * 
+     * @tparam F - Callable as f(EntityHandle, const AABB &).
+     * @param box - The box to search.
+     * @param f - Called once with the handle and box of each overlapping Entity.
+     */
+    template <class F>
+    void UniformGrid::query_aabb(const AABB &box, F f) const
+    {
+        CellRange range = this->range_of(box);
+        auto visit = [&](const Cell &cell) {
+            for (size_t eid : cell.eids)
+            {
+                const Entry &entry = this->entries[eid];
+                // Only report the Entity from the first cell it shares with the query.
+                if (std::max(entry.range.x0, range.x0) != cell.x || std::max(entry.range.y0, range.y0) != cell.y)
+                    continue;
+                if (entry.box.overlaps(box))
+                    f(entry.handle, entry.box);
+            }
+        };
+
+        uint64_t n_covered = static_cast<uint64_t>(range.x1 - range.x0 + 1) * static_cast<uint64_t>(range.y1 - range.y0 + 1);
+        if (n_covered > this->cells.size())
+        {
+            for (auto &cell : this->cells)
+            {
+                if (cell.second.x >= range.x0 && cell.second.x <= range.x1 && cell.second.y >= range.y0 && cell.second.y <= range.y1)
+                    visit(cell.second);
+            }
+            return;
+        }
+
+        for (int32_t x = range.x0; x <= range.x1; x++)
+        {
+            for (int32_t y = range.y0; y <= range.y1; y++)
+            {
+                auto it = this->cells.find(UniformGrid::key(x, y));
+                if (it != this->cells.end())
+                    visit(it->second);
+            }
+        }
+    }
+
+    /**
+     * @brief Finds every Entity whose box overlaps a box.
+     * 
+     * @param box - The box to search.
+     * @return std::vector<EntityHandle> - The handles of the overlapping Entities.
+     */
+    std::vector<EntityHandle> UniformGrid::query_aabb(const AABB &box) const
+    {
+        std::vector<EntityHandle> found;
+        this->query_aabb(box, [&found](EntityHandle handle, const AABB &) { found.push_back(handle); });
+        return found;
+    }
+
+    /**
+     * @brief Calls a function for each pair of Entities whose boxes overlap.
+     * 
+     * Only Entities which share a cell are compared. Each pair is reported once, from
+     * the first cell shared by both boxes.
+     * 
+     * @tparam F - Callable as f(EntityHandle, EntityHandle).
+     * @param f - Called once with the handles of each overlapping pair.
+     */
+    template <class F>
+    void UniformGrid::for_each_pair(F f) const
+    {
+        for (auto &it : this->cells)
+        {
+            const Cell &cell = it.second;
+            for (size_t i = 0; i < cell.eids.size(); i++)
+            {
+                const Entry &a = this->entries[cell.eids[i]];
+                for (size_t j = i + 1; j < cell.eids.size(); j++)
+                {
+                    const Entry &b = this->entries[cell.eids[j]];
+                    if (std::max(a.range.x0, b.range.x0) != cell.x || std::max(a.range.y0, b.range.y0) != cell.y)
+                        continue;
+                    if (a.box.overlaps(b.box))
+                        f(a.handle, b.handle);
+                }
+            }
+        }
+    }
+
+} // namespace ecs::spatial
+
+#endif
@@ -1,7 +1,10 @@
 #ifndef ecs_system_hpp
 #define ecs_system_hpp
 
+#include <algorithm>
+#include <stdexcept>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 #include <ecs/world.hpp>
 #include <ecs/entity.hpp>
@@ -13,6 +16,37 @@ using ecs::world::World;
 namespace ecs::system
 {
 
+    /**
+     * @brief Adds a System parameter to the access of the System.
+     * 
+     * A const parameter is read, and any other parameter is written. Entities are only
+     * changed when the Commands of a dispatch are merged, and the WorldResource can be
+     * used by many Systems at once, so neither makes Systems conflict. A System with the
+     * WorldResource may make Commands though, which its dependents must see.
+     * 
+     * The components a System reads or writes directly through the WorldResource, such
+     * as with World::get_component(), aren't parameters, so they must be declared by 
+     * overriding extra_access() of the System.
+     * 
+     * @tparam P - The parameter type.
+     * @param world_ptr - The World the System is added to.
+     * @param access - The access of the System.
+     */
+    template <class P>
+    void declare_access(World *world_ptr, ecs::dispatch::Access &access)
+    {
+        using T = std::remove_const_t<P>;
+        if constexpr (std::is_same_v<T, ecs::world::WorldResource>)
+            access.commands = true;
+        else if constexpr (!std::is_same_v<T, Entity>)
+        {
+            if constexpr (std::is_const_v<P>)
+                access.reads.set(world_ptr->get_cid<T>());
+            else
+                access.writes.set(world_ptr->get_cid<T>());
+        }
+    }
+
     /**
      * @brief Abstract class to be implemented by stateful systems
      * 
@@ -21,6 +55,17 @@ namespace ecs::system
      * which provides and implement a generic exec() function which fetches all entities
      * with the component parameters and calls run on each. 
      * 
+     * The entities are fetched through a Query which is made when the System is added to
+     * a World, so only the matching entities are visited each time the System is run.
+     * 
+     * A parameter which is only read should be const, e.g. System<Position, const Velocity>.
+     * The dispatcher lets Systems which only read the same components run in parallel.
+     * A System which uses other components through the WorldResource must declare them
+     * in extra_access().
+     * 
+     * A System whose parameters are all resources isn't run per entity. It is run once
+     * each time it is executed, with the resources found when the System was set up.
+     * 
      * @tparam Params - The components required for this system.
      */
     template <class... Params>
@@ -28,14 +73,279 @@ namespace ecs::system
     {
     public:
         using system_data = std::tuple<Params *...>;
+
+    private:
+        World *query_world = nullptr;
+        ecs::query::Query<std::remove_const_t<Params>...> query;
+        bool resource_only = false;
+        system_data resources;
+
+    public:
         virtual void run(system_data) = 0;
+
+        /**
+         * @brief Adds the components used other than through the parameters to the access.
+         * 
+         * Overridden by Systems which use components through the WorldResource, with
+         * declare_access() for each of them. By default nothing is added.
+         */
+        virtual void extra_access(World *, ecs::dispatch::Access &) const {}
+        void setup(World *world_ptr) final
+        {
+            this->query = world_ptr->query<std::remove_const_t<Params>...>();
+            this->query_world = world_ptr;
+
+            // If every parameter is a resource, the mask is empty and would match every
+            // entity, so the System is run once with the resources instead.
+            this->resource_only = world_ptr->mask<std::remove_const_t<Params>...>().none();
+            if (this->resource_only)
+                this->resources = system_data(world_ptr->find<std::remove_const_t<Params>>()->template get<std::remove_const_t<Params>>(0)...);
+        }
+        ecs::dispatch::Access access(World *world_ptr) const final
+        {
+            ecs::dispatch::Access a;
+            (declare_access<Params>(world_ptr, a), ...);
+            this->extra_access(world_ptr, a);
+            return a;
+        }
         void exec(World *world_ptr) final
         {
-            for (auto data : world_ptr->fetch<Params...>())
+            if (this->query_world != world_ptr)
+                this->setup(world_ptr);
+            if (this->resource_only)
+            {
+                this->run(this->resources);
+                return;
+            }
+            for (auto data : world_ptr->fetch(this->query))
                 this->run(data);
         }
     };
 
+    /**
+     * @brief Abstract class for systems which run over their entities in parallel
+     * 
+     * A ParallelSystem is written the same way as a System, but exec() splits the 
+     * matching entities into chunks, and the chunks are run on the World's ThreadPool. 
+     * This is worthwhile for systems which do the same independent work for many 
+     * entities, such as moving every entity by its velocity.
+     * 
+     * Since run() is called from several threads at once, it must only write to the 
+     * components it is given, and must not change any state of the system itself without
+     * synchronization. Using the WorldResource from run() is safe.
+     * 
+     * Chunks are never smaller than the minimum chunk size, so that small systems aren't
+     * slowed down by the cost of scheduling. If all of the entities fit in one chunk, 
+     * they are run on the calling thread.
+     * 
+     * @tparam Params - The components required for this system.
+     */
+    template <class... Params>
+    class ParallelSystem : public Executable
+    {
+    public:
+        using system_data = std::tuple<Params *...>;
+
+    private:
+        World *query_world = nullptr;
+        ecs::query::Query<std::remove_const_t<Params>...> query;
+        size_t min_chunk;
+        bool resource_only = false;
+        system_data resources;
+
+    public:
+        ParallelSystem(size_t min_chunk_size = 1024) : min_chunk(min_chunk_size) {}
+        virtual void run(system_data) = 0;
+
+        /**
+         * @brief Adds the components used other than through the parameters to the access.
+         * 
+         * Overridden by Systems which use components through the WorldResource, with
+         * declare_access() for each of them. By default nothing is added.
+         */
+        virtual void extra_access(World *, ecs::dispatch::Access &) const {}
+        void setup(World *world_ptr) final
+        {
+            this->query = world_ptr->query<std::remove_const_t<Params>...>();
+            this->query_world = world_ptr;
+            this->resource_only = world_ptr->mask<std::remove_const_t<Params>...>().none();
+            if (this->resource_only)
+                this->resources = system_data(world_ptr->find<std::remove_const_t<Params>>()->template get<std::remove_const_t<Params>>(0)...);
+        }
+        ecs::dispatch::Access access(World *world_ptr) const final
+        {
+            ecs::dispatch::Access a;
+            (declare_access<Params>(world_ptr, a), ...);
+            this->extra_access(world_ptr, a);
+            return a;
+        }
+        void exec(World *world_ptr) final
+        {
+            if (this->query_world != world_ptr)
+                this->setup(world_ptr);
+            if (this->resource_only)
+            {
+                this->run(this->resources);
+                return;
+            }
+            size_t n = world_ptr->count(this->query);
+            world_ptr->thread_pool()->parallel_for(n, this->min_chunk, [this, world_ptr](size_t first, size_t last) {
+                for (auto data : world_ptr->fetch(this->query, first, last))
+                    this->run(data);
+            });
+        }
+    };
+
+    /**
+     * @brief A contiguous array of components, given to a BatchSystem.
+     * 
+     * @tparam T - The component type, const if it's only read.
+     */
+    template <class T>
+    class Span
+    {
+    private:
+        T *ptr;
+        size_t n;
+
+    public:
+        Span() : ptr(nullptr), n(0) {}
+        Span(T *data, size_t size) : ptr(data), n(size) {}
+
+        T *data() const { return this->ptr; }
+        size_t size() const { return this->n; }
+        T &operator[](size_t i) const { return this->ptr[i]; }
+        T *begin() const { return this->ptr; }
+        T *end() const { return this->ptr + this->n; }
+    };
+
+    /**
+     * @brief Abstract class for systems which run over arrays of entities at once
+     * 
+     * A System is called once per entity through a virtual function, so the compiler 
+     * can't vectorize across entities. A BatchSystem's run() is given a Span of each 
+     * component instead, where the ith element of every Span belongs to the same entity,
+     * so the work for many entities can be written as a plain loop:
+     * 
+     * ```cpp
+     * class Movement : public BatchSystem<Position, const Velocity>
+     * {
+     *     void run(batch_data data)
+     *     {
+     *         auto pos = std::get<0>(data);
+     *         auto vel = std::get<1>(data);
+     *         for (size_t i = 0; i < pos.size(); i++)
+     *             pos[i].x += vel[i].dx;
+     *     }
+     * };
+     * ```
+     * 
+     * The matching entities are found in runs with World::for_each_batch(), which are
+     * whole Archetypes with Archetype storage, and stretches of entities whose 
+     * components are next to each other with SparseSet storage. The runs are split into
+     * chunks which are run on the World's ThreadPool, in the same way as a 
+     * ParallelSystem, and with the same rules for run().
+     * 
+     * Only components stored as AoS can be parameters, since a Span is an array of 
+     * whole components. A component stored as SoA has no such array, and setup() throws
+     * for it; its columns are reached with World::for_each_chunk() instead, which only 
+     * iterates one component at a time with SparseSet storage. Resources, the Entity 
+     * component and the WorldResource can't be parameters either.
+     * 
+     * Components used other than through the parameters are declared by overriding 
+     * extra_access(), as with a System.
+     * 
+     * @tparam Params - The components required for this system.
+     */
+    template <class... Params>
+    class BatchSystem : public Executable
+    {
+    public:
+        using batch_data = std::tuple<Span<Params>...>;
+
+    private:
+        struct Batch
+        {
+            size_t first;
+            size_t size;
+            std::tuple<Params *...> data;
+        };
+
+        World *query_world = nullptr;
+        ecs::query::Query<std::remove_const_t<Params>...> query;
+        size_t min_chunk;
+        std::vector<Batch> batches;
+
+        void run_range(size_t first, size_t last);
+
+    public:
+        BatchSystem(size_t min_chunk_size = 1024) : min_chunk(min_chunk_size) {}
+        virtual void run(batch_data) = 0;
+
+        /**
+         * @brief Adds the components used other than through the parameters to the access.
+         * 
+         * Overridden by BatchSystems which use other components, with declare_access() for
+         * each of them. By default nothing is added.
+         */
+        virtual void extra_access(World *, ecs::dispatch::Access &) const {}
+        void setup(World *world_ptr) final
+        {
+            static_assert(!(std::is_same_v<std::remove_const_t<Params>, Entity> || ...), "The Entity component can't be a parameter of a BatchSystem");
+            for (RegistryNode *node : {world_ptr->find<std::remove_const_t<Params>>()...})
+            {
+                if (node->is_resource())
+                    throw std::runtime_error("Resources can't be parameters of a BatchSystem");
+                if (node->get_layout() != ecs::registry::Layout::AoS)
+                    throw std::runtime_error("Components stored as SoA can't be parameters of a BatchSystem");
+            }
+            this->query = world_ptr->query<std::remove_const_t<Params>...>();
+            this->query_world = world_ptr;
+        }
+        ecs::dispatch::Access access(World *world_ptr) const final
+        {
+            ecs::dispatch::Access a;
+            (declare_access<Params>(world_ptr, a), ...);
+            this->extra_access(world_ptr, a);
+            return a;
+        }
+        void exec(World *world_ptr) final
+        {
+            if (this->query_world != world_ptr)
+                this->setup(world_ptr);
+
+            size_t n = 0;
+            this->batches.clear();
+            world_ptr->for_each_batch(this->query, [this, &n](size_t size, std::remove_const_t<Params> *... data) {
+                this->batches.push_back({n, size, std::tuple<Params *...>(data...)});
+                n += size;
+            });
+            world_ptr->thread_pool()->parallel_for(n, this->min_chunk, [this](size_t first, size_t last) {
+                this->run_range(first, last);
+            });
+        }
+    };
+
+    /**
+     * @brief Runs the positions [first, last) of the batches, split at batch boundaries.
+     * 
+     * @param first - The first position to run.
+     * @param last - The position to stop at.
+     */
+    template <class... Params>
+    void BatchSystem<Params...>::run_range(size_t first, size_t last)
+    {
+        auto it = std::upper_bound(this->batches.begin(), this->batches.end(), first, [](size_t pos, const Batch &batch) {
+            return pos < batch.first;
+        });
+        for (--it; it != this->batches.end() && it->first < last; ++it)
+        {
+            size_t begin = std::max(first, it->first) - it->first;
+            size_t end = std::min(last, it->first + it->size) - it->first;
+            this->run(std::apply([begin, end](Params *... data) { return batch_data(Span<Params>(data + begin, end - begin)...); }, it->data));
+        }
+    }
+
 } // namespace ecs::system
 
 #endif
\ No newline at end of file
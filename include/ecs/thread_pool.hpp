@@ -0,0 +1,391 @@
+#ifndef ecs_thread_pool_hpp
+#define ecs_thread_pool_hpp
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ecs::thread_pool
+{
+
+    /**
+     * @brief A set of tasks which can be waited on together.
+     * 
+     * The first exception thrown by a task in the group is kept, and rethrown by
+     * ThreadPool::wait().
+     * 
+     * A thread waiting on the group sleeps on it while none of its tasks are queued, and
+     * is woken when a task of the group is queued or the last one finishes.
+     * 
+     */
+    class TaskGroup
+    {
+    private:
+        std::atomic<size_t> pending;
+        std::atomic<size_t> queued;
+        std::mutex guard;
+        std::condition_variable wake;
+        std::mutex error_guard;
+        std::exception_ptr error;
+        friend class ThreadPool;
+
+    public:
+        TaskGroup() : pending(0), queued(0), error(nullptr) {}
+        ~TaskGroup() = default;
+        TaskGroup(const TaskGroup &) = delete;
+    };
+
+    /**
+     * @brief A persistent pool of worker threads with work-stealing task queues.
+     * 
+     * Starting a thread costs far more than running most Systems, so the World keeps a
+     * ThreadPool for its whole lifetime rather than starting threads on every dispatch.
+     * 
+     * Every worker has its own deque of tasks. A worker takes tasks from the back of its
+     * own deque, and when it runs out, steals from the front of the other deques. Tasks
+     * submitted from a thread which isn't a worker go into an extra deque, which the
+     * workers steal from as well.
+     * 
+     * A thread waiting on a TaskGroup runs the queued tasks of that group while it waits,
+     * and only sleeps once the rest of them are running on other threads. This means a
+     * pool with no workers still works, running every task in the waiting thread, and a
+     * task can itself submit and wait on more tasks without deadlocking. Tasks of other
+     * groups are left to the workers, so a System waiting on its own chunks never runs
+     * an unrelated System on top of them.
+     * 
+     */
+    class ThreadPool
+    {
+    private:
+        struct Task
+        {
+            TaskGroup *group;
+            std::function<void()> run;
+        };
+
+        struct TaskQueue
+        {
+            std::mutex guard;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<TaskQueue>> queues;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> queued;
+        bool running;
+        std::mutex sleep_guard;
+        std::condition_variable wake;
+
+        static size_t &worker_index()
+        {
+            static thread_local size_t index = 0;
+            return index;
+        }
+        static const ThreadPool *&worker_pool()
+        {
+            static thread_local const ThreadPool *pool = nullptr;
+            return pool;
+        }
+
+        size_t local_queue() const;
+        void push(TaskGroup &group, std::function<void()> &&task);
+        bool try_pop(Task &task, const TaskGroup *group = nullptr);
+        void work(size_t index);
+
+    public:
+        ThreadPool(size_t n_threads);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool &) = delete;
+
+        size_t size() const;
+        size_t thread_index() const;
+        void run(TaskGroup &group, std::function<void()> task);
+        void wait(TaskGroup &group);
+        bool run_one();
+        void parallel_for(size_t n, size_t min_chunk, const std::function<void(size_t, size_t)> &f);
+    };
+
+    /**
+     * @brief Construct a new ThreadPool object and start its workers.
+     * 
+     * @param n_threads - The number of worker threads. The threads waiting on tasks also
+     *                    run tasks, so this can be 0.
+     */
+    ThreadPool::ThreadPool(size_t n_threads) : queued(0), running(true)
+    {
+        for (size_t i = 0; i <= n_threads; i++)
+            this->queues.push_back(std::make_unique<TaskQueue>());
+        for (size_t i = 1; i <= n_threads; i++)
+            this->threads.emplace_back(&ThreadPool::work, this, i);
+    }
+
+    /**
+     * @brief Stops the workers once every queued task has been run, and joins them.
+     * 
+     */
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->sleep_guard);
+            this->running = false;
+        }
+        this->wake.notify_all();
+        for (auto &thread : this->threads)
+            thread.join();
+    }
+
+    /**
+     * @brief Getter function for the number of worker threads.
+     * 
+     * @return size_t
+     */
+    size_t ThreadPool::size() const
+    {
+        return this->threads.size();
+    }
+
+    /**
+     * @brief Getter function for the index of the calling thread in the pool.
+     * 
+     * @return size_t - In [1, size()] for a worker, and 0 for any other thread.
+     */
+    size_t ThreadPool::thread_index() const
+    {
+        return this->local_queue();
+    }
+
+    /**
+     * @brief Getter function for the deque of the calling thread.
+     * 
+     * @return size_t - The index of the deque. 0 if the thread isn't a worker of this pool.
+     */
+    size_t ThreadPool::local_queue() const
+    {
+        return ThreadPool::worker_pool() == this ? ThreadPool::worker_index() : 0;
+    }
+
+    /**
+     * @brief Adds a task to the deque of the calling thread, and wakes a worker and the
+     * threads waiting on the task's group.
+     * 
+     * @param group - The TaskGroup of the task.
+     * @param task - The task. This is consumed.
+     */
+    void ThreadPool::push(TaskGroup &group, std::function<void()> &&task)
+    {
+        TaskQueue &queue = *this->queues[this->local_queue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.guard);
+            queue.tasks.push_back({&group, std::move(task)});
+        }
+        {
+            std::lock_guard<std::mutex> lock(group.guard);
+            group.queued++;
+        }
+        group.wake.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(this->sleep_guard);
+            this->queued++;
+        }
+        this->wake.notify_one();
+    }
+
+    /**
+     * @brief Takes a task from the calling thread's deque, or steals one from another.
+     * 
+     * @param task - Set to the task which was taken.
+     * @param group - If given, only a task of this TaskGroup is taken.
+     * @return true - A task was taken.
+     * @return false - There are no tasks.
+     */
+    bool ThreadPool::try_pop(Task &task, const TaskGroup *group)
+    {
+        auto matches = [group](const Task &t) { return group == nullptr || t.group == group; };
+        size_t local = this->local_queue();
+        {
+            TaskQueue &queue = *this->queues[local];
+            std::lock_guard<std::mutex> lock(queue.guard);
+            auto it = std::find_if(queue.tasks.rbegin(), queue.tasks.rend(), matches);
+            if (it != queue.tasks.rend())
+            {
+                task = std::move(*it);
+                queue.tasks.erase(std::next(it).base());
+                task.group->queued--;
+                this->queued--;
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < this->queues.size(); i++)
+        {
+            TaskQueue &queue = *this->queues[(local + i) % this->queues.size()];
+            std::lock_guard<std::mutex> lock(queue.guard);
+            auto it = std::find_if(queue.tasks.begin(), queue.tasks.end(), matches);
+            if (it != queue.tasks.end())
+            {
+                task = std::move(*it);
+                queue.tasks.erase(it);
+                task.group->queued--;
+                this->queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief The loop run by each worker thread.
+     * 
+     * A worker sleeps while there are no tasks queued, and returns once the pool is
+     * stopped and every queued task has been run.
+     * 
+     * @param index - The index of the worker's deque.
+     */
+    void ThreadPool::work(size_t index)
+    {
+        ThreadPool::worker_pool() = this;
+        ThreadPool::worker_index() = index;
+
+        Task task;
+        while (true)
+        {
+            if (this->try_pop(task))
+            {
+                task.run();
+                task.run = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(this->sleep_guard);
+            this->wake.wait(lock, [this]() { return !this->running || this->queued > 0; });
+            if (!this->running && this->queued == 0)
+                return;
+        }
+    }
+
+    /**
+     * @brief Queues a task to be run as part of a TaskGroup.
+     * 
+     * @param group - The TaskGroup. This must outlive the task, see ThreadPool::wait().
+     * @param task - The task to run.
+     */
+    void ThreadPool::run(TaskGroup &group, std::function<void()> task)
+    {
+        group.pending++;
+        this->push(group, [&group, task = std::move(task)]() {
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(group.error_guard);
+                if (!group.error)
+                    group.error = std::current_exception();
+            }
+            // The waiting thread may destroy the group as soon as it sees the last task
+            // finish, so it is notified under the lock, which it takes before returning.
+            std::lock_guard<std::mutex> lock(group.guard);
+            group.pending--;
+            group.wake.notify_all();
+        });
+    }
+
+    /**
+     * @brief Waits for every task of a TaskGroup to finish.
+     * 
+     * The calling thread runs the queued tasks of the group while it waits, and sleeps
+     * while the rest of them are running on other threads. Tasks of other groups are
+     * never run, so the time spent here is only spent on this group.
+     * 
+     * @param group - The TaskGroup.
+     * 
+     * @exception Rethrows the first exception thrown by a task of the group.
+     */
+    void ThreadPool::wait(TaskGroup &group)
+    {
+        Task task;
+        while (true)
+        {
+            if (this->try_pop(task, &group))
+            {
+                task.run();
+                task.run = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(group.guard);
+            group.wake.wait(lock, [&group]() { return group.pending == 0 || group.queued > 0; });
+            if (group.pending == 0)
+                break;
+        }
+
+        if (group.error)
+        {
+            std::exception_ptr error = group.error;
+            group.error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief Runs one queued task on the calling thread, if there is one.
+     * 
+     * This lets a thread which is waiting on something other than a TaskGroup help the
+     * workers instead of blocking.
+     * 
+     * @return true - A task was run.
+     * @return false - There were no tasks.
+     */
+    bool ThreadPool::run_one()
+    {
+        Task task;
+        if (!this->try_pop(task))
+            return false;
+        task.run();
+        return true;
+    }
+
+    /**
+     * @brief Runs f over the range [0, n) split into chunks, in parallel.
+     * 
+     * The range is split into a few chunks per thread so that uneven chunks can be
+     * balanced by stealing, but chunks are never smaller than min_chunk. If there would
+     * only be one chunk, f is called directly. The calling thread runs chunks while it
+     * waits for the rest.
+     * 
+     * @param n - The size of the range.
+     * @param min_chunk - The smallest number of elements given to a task.
+     * @param f - Called with the [begin, end) of each chunk.
+     */
+    void ThreadPool::parallel_for(size_t n, size_t min_chunk, const std::function<void(size_t, size_t)> &f)
+    {
+        if (n == 0)
+            return;
+
+        size_t n_chunks = (this->size() + 1) * 4;
+        size_t chunk = std::max<size_t>(std::max<size_t>(min_chunk, 1), (n + n_chunks - 1) / n_chunks);
+        if (chunk >= n)
+        {
+            f(0, n);
+            return;
+        }
+
+        TaskGroup group;
+        for (size_t begin = 0; begin < n; begin += chunk)
+        {
+            size_t end = std::min(n, begin + chunk);
+            this->run(group, [&f, begin, end]() { f(begin, end); });
+        }
+        this->wait(group);
+    }
+
+} // namespace ecs::thread_pool
+
+#endif
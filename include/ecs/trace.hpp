@@ -0,0 +1,169 @@
+#ifndef ecs_trace_hpp
+#define ecs_trace_hpp
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ecs::trace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief A span of time spent on one thread, such as a System running.
+     * 
+     */
+    struct TraceEvent
+    {
+        std::string name;
+        const char *category;
+        Clock::time_point begin;
+        Clock::time_point end;
+    };
+
+    /**
+     * @brief Records what each thread of a World spends its time on during dispatches.
+     * 
+     * Every thread has its own list of events, which only it appends to, so recording
+     * an event never takes a lock. A World only has a Tracer while tracing is enabled,
+     * see World::enable_tracing(), so a World which isn't traced only pays for checking
+     * that it has no Tracer.
+     * 
+     * The events can be written out in the Chrome trace event format, which can be
+     * opened with chrome://tracing or Perfetto.
+     * 
+     */
+    class Tracer
+    {
+    private:
+        struct ThreadEvents
+        {
+            std::vector<TraceEvent> events;
+        };
+
+        std::vector<std::unique_ptr<ThreadEvents>> threads;
+        Clock::time_point origin;
+
+        static void write_string(std::ostream &out, const std::string &str);
+
+    public:
+        Tracer(size_t n_threads);
+        ~Tracer() = default;
+        Tracer(const Tracer &) = delete;
+
+        void record(size_t thread, const std::string &name, const char *category, Clock::time_point begin, Clock::time_point end);
+        size_t size() const;
+        void clear();
+        void write_chrome_trace(std::ostream &out) const;
+    };
+
+    /**
+     * @brief Construct a new Tracer object without any events.
+     * 
+     * @param n_threads - The number of threads which record events, including the
+     *                    thread calling World::dispatch().
+     */
+    Tracer::Tracer(size_t n_threads) : origin(Clock::now())
+    {
+        for (size_t i = 0; i < n_threads; i++)
+            this->threads.push_back(std::make_unique<ThreadEvents>());
+    }
+
+    /**
+     * @brief Adds an event to the events of a thread.
+     * 
+     * This must only be called by the thread itself.
+     * 
+     * @param thread - The index of the thread in the ThreadPool, 0 for the main thread.
+     * @param name - The name of the event, e.g. the name the System was added with.
+     * @param category - The kind of event, e.g. "system" or "merge".
+     * @param begin - When the event began.
+     * @param end - When the event ended.
+     */
+    void Tracer::record(size_t thread, const std::string &name, const char *category, Clock::time_point begin, Clock::time_point end)
+    {
+        this->threads.at(thread)->events.push_back({name, category, begin, end});
+    }
+
+    /**
+     * @brief Getter function for the number of recorded events.
+     * 
+     * @return size_t
+     */
+    size_t Tracer::size() const
+    {
+        size_t n = 0;
+        for (auto &thread : this->threads)
+            n += thread->events.size();
+        return n;
+    }
+
+    /**
+     * @brief Removes every recorded event.
+     * 
+     * The time of later events is still measured from when the Tracer was made.
+     * 
+     */
+    void Tracer::clear()
+    {
+        for (auto &thread : this->threads)
+            thread->events.clear();
+    }
+
+    /**
+     * @brief Writes a string as a JSON string literal.
+     * 
+     * @param out - The stream to write to.
+     * @param str - The string.
+     */
+    void Tracer::write_string(std::ostream &out, const std::string &str)
+    {
+        static const char *hex = "0123456789abcdef";
+        out << '"';
+        for (char c : str)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20)
+                out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+            else
+                out << c;
+        }
+        out << '"';
+    }
+
+    /**
+     * @brief Writes every recorded event as Chrome trace event JSON.
+     * 
+     * Each event is a complete ("X") event, with its thread index as its tid. Times are
+     * in microseconds since the Tracer was made.
+     * 
+     * @param out - The stream to write to.
+     */
+    void Tracer::write_chrome_trace(std::ostream &out) const
+    {
+        using Micros = std::chrono::duration<double, std::micro>;
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (size_t tid = 0; tid < this->threads.size(); tid++)
+        {
+            for (auto &event : this->threads[tid]->events)
+            {
+                if (!first)
+                    out << ",";
+                first = false;
+                out << "\n{\"name\":";
+                Tracer::write_string(out, event.name);
+                out << ",\"cat\":\"" << event.category << "\",\"ph\":\"X\"";
+                out << ",\"ts\":" << Micros(event.begin - this->origin).count();
+                out << ",\"dur\":" << Micros(event.end - event.begin).count();
+                out << ",\"pid\":0,\"tid\":" << tid << "}";
+            }
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+} // namespace ecs::trace
+
+#endif
@@ -156,26 +156,68 @@
  * wrapper around the std::vector class. In order for a RegistryNode to be non-templated,
  * each function that operates on a ecs::registry::RegistryNode is templated in exchange.
  * This allows the World to have a single container (std::vector) of 
- * ecs::registry::RegistryNode for each component and resource. 
+ * ecs::registry::RegistryNode for each component and resource. Every type is given a 
+ * small id by ecs::registry::type_id(), and the World keeps a vector from type id to
+ * RegistryNode, so finding the RegistryNode of a type is an array index.
+ * 
+ * Every access through a RegistryNode checks that the type is correct. In loops, such as
+ * fetching components for a System, an ecs::registry::ComponentPool is used instead. It
+ * is made once per fetch after a single type check, and then indexes the data directly.
+ * 
+ * Alternatively, a World can be built with ecs::world::StorageMode::Archetype, by 
+ * calling .with_storage() on the ecs::world::WorldBuilder. In this mode, Entities with
+ * the same set of components are stored together in an ecs::archetype::Archetype, a 
+ * table with one column per component. Fetching components then only visits the tables
+ * which have every component, at the cost of moving an Entity's components between 
+ * tables when a component is added or removed. Systems are written the same way for 
+ * both storage modes.
+ * 
+ * Plain numeric components, such as a position or a velocity, can also be laid out as
+ * a struct of arrays. Once the fields of a component are declared by specializing 
+ * ecs::soa::Fields, registering it with .with_component<T>(ecs::registry::Layout::SoA)
+ * stores each field in its own aligned column, see ecs::soa::Columns. Systems still see
+ * a T*, which points to a copy that the ecs::registry::ComponentPool writes back. The
+ * columns pay off in kernels run with World::for_each_chunk(), which hands over the 
+ * pools of each Archetype so a loop can walk one field, or a few, as plain arrays.
  * 
  * The ecs::registry::RegistryNode class handles resources in the same way as components,
  * but it ensuresonly one instance of a resource is kept at any given time, and accessing
- * a resource ignores always returns a pointer to the single instance.
+ * a resource ignores always returns a pointer to the single instance. A System whose
+ * parameters are all resources is run once per dispatch rather than once per Entity.
  * 
  * ### System Dispatching
- * The ecs::world::World ecs::dispatch::DispatcherContainer is a simple data structure
- * which groups Systems into 'stages' (which can be executed in parallel). Under the 
- * hood, this is a vector of vectors of ecs::dispatch::Executable pointers, where the
+ * The ecs::world::World ecs::dispatch::DispatcherContainer is the dependency graph of
+ * the Systems. Under the hood, this is a vector of ecs::dispatch::DispatcherNode, each
+ * holding an ecs::dispatch::Executable pointer and the indices of the Systems which
+ * depend on it, where the
  * ecs::dispatch::Executable class is used to generalize ecs::system::System execution,
  * without template arguments. The ecs::system::System and ecs::dispatch::Executable
  * classes will be discussed in more detail later. 
  * 
  * When adding an ecs::system::System to the ecs::world::World, you have to provide the
  * following: a pointer to the ecs::system::System, an identifier, and an initilizer list
- * of dependencies. Using this information, a graph is constructed. BFS topological sort
- * is then used to find systems which can be executed in parallel. The process is simple: 
- * find all nodes with in-degree of zero, add them to a ecs::dispatch::DispatchStage, 
- * remove them from the graph, and repeat until no nodes are left in the graph. Each 
+ * of dependencies. Each System also declares which components it reads (const T) and
+ * writes (T), and is made to depend on every System added before it which writes a
+ * component it uses, or uses a component it writes. Systems which only read the same
+ * components are free to run in parallel. Components used through the 
+ * ecs::world::WorldResource rather than as parameters are declared by overriding
+ * extra_access() of the System. Using this information, a graph is 
+ * constructed. The graph is run as a set of tasks on the World's 
+ * ecs::thread_pool::ThreadPool: each System keeps count of its dependencies which are
+ * yet to finish, and is queued as soon as the last of them finishes, so a slow System
+ * only holds back the Systems which depend on it. The run time of each System is
+ * measured, and when more Systems are ready than there are threads, the System with the
+ * costliest chain of Systems after it is run first. These priorities are planned again
+ * whenever the measured costs shift. Systems which must run on the thread
+ * calling dispatch, such as Systems which draw with a graphics context, are added with
+ * add_main_thread_system(). The ThreadPool's worker threads are started once when 
+ * the World is built, and the number of workers can be set with .with_threads() on the
+ * ecs::world::WorldBuilder.
+ * 
+ * To see where the time of a dispatch goes, World::enable_tracing() gives the World an
+ * ecs::trace::Tracer, which records when each System and merge ran, and on which thread.
+ * The recorded events can be written as Chrome trace event JSON and viewed in
+ * chrome://tracing or Perfetto.
  * 
  * ### World Builder
  * Creating a ecs::world::World is done via the ecs::world::WorldBuilder class. This 
@@ -232,6 +274,21 @@
  * This implementation of the ecs::entity::Entity class makes executing systems much 
  * slower in the worse case as described below.
  * 
+ * Each ecs::entity::Entity is identified by an ecs::entity::EntityHandle, made of a 32 
+ * bit index and a 32 bit generation. The index is the Entity id, and is reused once the
+ * Entity has been removed, while the generation is increased so that old handles can be
+ * told apart from the new Entity. A handle can be kept outside of the World, and turned
+ * back into an Entity in constant time with ecs::world::World::get_entity(), which 
+ * returns nullptr if the Entity has since been removed. A single component can be found
+ * the same way with ecs::world::World::get_component().
+ * 
+ * Handles are also what ecs::spatial::UniformGrid stores. The grid is a resource which
+ * keeps the bounding box of each Entity in a uniform grid of cells, so that finding the
+ * Entities which overlap a box, or every overlapping pair, only searches the cells
+ * nearby instead of every Entity. In the Pong demo, the BallWallCollisionSystem keeps
+ * the box of every ball up to date, and the BallPaddleCollisionSystem only checks the
+ * balls the grid finds near each paddle.
+ * 
  * ## The System and Executable Classes
  * The ecs::system::System class is a templated class which can be inherited. All that is
  * required is that the function ecs::system::System::run() is defined. 
@@ -254,20 +311,37 @@
  * template <class ... Params>
  * void System<Params...>::exec(World *world_ptr) final
  * { 
- *     for (auto data : world_ptr->fetch<Params...>())
+ *     for (auto data : world_ptr->fetch(this->query))
  *         this->run(data);
  * }
  * ```
  * Notably, this is where the performance cost of the implementation of the 
- * ecs::entity::Entity class is relevant. the ecs::world::World::fetch<Params...>() 
+ * ecs::entity::Entity class is relevant. The ecs::world::World::fetch<Params...>() 
  * function has to loop through every Entity to find if it has the relevant components. 
- * Thus executing a System is O(n), where n is the number of entities in the world.
- * 
- * An alternate solution would be to have the RegistryNodes track the Entity when a 
- * component is added to the RegistryNode. Since every component has a separate 
- * RegistryNode, you could perform an intersection of the Entities found in each registry
- * nodes which would still be O(n), but the overall amount of work would be reduced, even
- * if not on an exponential scale.
+ * Thus fetching is O(n), where n is the number of entities in the world.
+ * 
+ * To avoid this, a System makes an ecs::query::Query<Params...> when it is added to the
+ * World. The World keeps the Entities matching each Query up to date whenever an Entity
+ * is built or removed, or has a component added or removed. Fetching a Query then only
+ * visits the matching Entities, so executing a System is O(m), where m is the number of
+ * Entities the System runs on.
+ * 
+ * Fetching returns an ecs::world::World::View rather than a container. The View finds
+ * the matching Entities and builds each tuple of component pointers as it's iterated,
+ * so running a System, or fetching from inside a System, doesn't allocate.
+ * 
+ * A System which does the same independent work for many Entities can inherit from 
+ * ecs::system::ParallelSystem instead. Its matching Entities are split into chunks, 
+ * which are run in parallel on the World's ecs::thread_pool::ThreadPool.
+ * 
+ * When the work is simple enough to vectorize, such as adding a velocity to a position,
+ * an ecs::system::BatchSystem is given an ecs::system::Span of each component rather
+ * than one Entity at a time, and loops over the Spans itself. The Spans are the runs of
+ * World::for_each_batch(): whole Archetypes, or stretches of Entities whose components
+ * are stored next to each other. Like a ParallelSystem, the runs are split over the
+ * ThreadPool. Only components stored as AoS can be given to a BatchSystem, since a Span
+ * is an array of whole components; kernels over SoA columns use World::for_each_chunk().
+ * The per-entity ecs::system::System remains the simple way to write a System.
  * 
  * ## Systems interacting with Entities
  * A particular challange of this project was allowing systems to operate on entites and
@@ -277,32 +351,47 @@
  * altogether. 
  * 
  * The fact that systems may be executing in parallel makes adding/removing components 
- * particularly tricky. As such, all modifications to the world is done between dispatch
- * stages. As such the ecs::world::WorldResource keeps vectors of lambda functions which
- * perform the insertion/removal of the components into the world. These lambda functions
- * are run  after every system in a stage has finished executing.  
+ * particularly tricky. As such, all modifications to the world is done while no System
+ * is running. As such the ecs::world::WorldResource records each change as a small 
+ * ecs::command::Command in an ecs::command::CommandBuffer. Every thread which runs 
+ * Systems has its own CommandBuffer, so recording a change never takes a lock, and the
+ * components being added are moved into an arena owned by the buffer rather than into
+ * a heap allocated closure. The Commands are applied at the end of the dispatch, or
+ * earlier if a System which depends on the System which made them is ready to run. The
+ * dependent System is then held back until every running System has finished, so that
+ * the Commands can be merged. A dispatch in which no Commands are made never stops to
+ * merge.  
  * 
  * Adding components is fairly easy, and the order in which the additions are done does
- * not matter. Removing components is much more difficult, because ecs::entity::Entity 
- * tracks the vector index of their components. For this reason, it is important that 
- * components are removed from highest index to lowest index. Additionally, since the
- * ecs::entity::Entity class is a component itself, it was important that Entities are
+ * not matter. Component RegistryNodes are sparse sets: each keeps the Entity id of its
+ * elements, and a map from Entity id to element index. Removing a component swaps it 
+ * with the last element of the RegistryNode and fixes the index of the moved element,
+ * so a removal is constant time and no other Entity needs to be touched. Since the
+ * ecs::entity::Entity class is a component itself, it is important that Entities are
  * removed last over other components, otherwise a number of problems can arise when 
  * removing components. 
  * 
  * Removing entities all together is particularly challenging, because an 
  * ecs::entity::Entity is not aware of the underlying types of it's components. As such,
- * entites are removed gradually over time. If a ecs::system::System *would* operate on 
- * an entity, and it has been flagged for removal, instead, the components are removed
- * at the end of the dispatch stage. Thus it is theoretically possible for an Entity to 
- * never fully be removed if it has components which are never operated on by Systems.
+ * each RegistryNode keeps a table of type erased operations for its component type,
+ * which includes erasing the component of an Entity id. When an Entity is removed, its
+ * removal is staged, and when the Commands are merged each of its components is 
+ * erased through this table, whether or not any System uses them. Many Entities can be
+ * removed at once with World::despawn_where<Ts...>().
  * 
  * Another factor to consider is that because the underlying data structure of the 
  * RegistryNode is a std::vector, a resize could occur when adding components. This is
- * why adding components had to be done after a dispatch stage, else it was possible for
+ * why adding components had to be done while no System is running, else it was possible for
  * pointers to components, which are returned by World::fetch<Ts...>() (which is used in
  * System<Ts...>::exec()), to point to memory which is no longer valid.
  * 
+ * The same is true of building new Entities from within a System. An 
+ * ecs::world::World::EntityBuilder used during a dispatch only stages its components, 
+ * and the Entities built are all added when the Commands are merged. The storage of
+ * each component type is grown once for the whole batch, rather than once per Entity.
+ * Outside of Systems, World::spawn_batch<Ts...>() adds any number of Entities directly
+ * from arrays of components, moving each array into its storage in one go.
+ * 
  * ## Conclusion
  * Overall this has been a really interesting project. I've had the oppertunity to 
  * explore an interesting design pattern to better understand how it works. Additionally,
@@ -322,5 +411,6 @@
 #include <ecs/world/world_class.hpp>
 #include <ecs/world/world_builder.hpp>
 #include <ecs/world/entity_builder.hpp>
+#include <ecs/world/view.hpp>
 
 #endif
\ No newline at end of file
@@ -12,21 +12,35 @@ namespace ecs::world
      * which comsumes t. Upon calling .build() the Entity is added to the World which 
      * it's a part of. 
      * 
-     * TODO: Delay adding the components until .build() is called.
+     * Nothing is added to the World until .build() is called. The components are moved
+     * into the CommandBuffer of the calling thread as they are given. Outside of
+     * World::dispatch() the Entity is added by .build() straight away. From within a
+     * System the Entity is only added when the Commands are merged, together with every
+     * other Entity built since the last merge, so building Entities never moves components
+     * which other Systems are using. The Entity id is decided when the Entity is added.
      * 
      */
     class World::EntityBuilder
     {
     private:
-        Entity entity;
         World *world_ptr;
+        ecs::command::CommandBuffer *buffer;
+        bitset components;
+        std::vector<ecs::command::Command> staged;
+
+        template <class T>
+        static void apply_spawn(World *w, const ecs::command::Command &command);
 
     public:
         EntityBuilder(World *ptr);
-        ~EntityBuilder(){};
+        EntityBuilder(EntityBuilder &&other);
+        EntityBuilder(const EntityBuilder &) = delete;
+        ~EntityBuilder();
 
         template <class T>
-        EntityBuilder &with(T &&t);
+        EntityBuilder &with(T &&t) &;
+        template <class T>
+        EntityBuilder &&with(T &&t) &&;
         void build();
     };
 
@@ -35,9 +49,36 @@ namespace ecs::world
      * 
      * @param ptr - A pointer to the World where the entity and its components will be added.
      */
-    World::EntityBuilder::EntityBuilder(World *ptr) : entity(ptr->get_eid(), ptr->count_components())
+    World::EntityBuilder::EntityBuilder(World *ptr)
     {
         this->world_ptr = ptr;
+        WorldResource *world_res = ptr->find<WorldResource>()->get<WorldResource>(0);
+        this->buffer = &world_res->local_buffer();
+        this->buffer->acquire();
+    }
+
+    World::EntityBuilder::EntityBuilder(EntityBuilder &&other)
+    {
+        this->world_ptr = other.world_ptr;
+        this->buffer = other.buffer;
+        this->components = other.components;
+        this->staged = std::move(other.staged);
+        other.buffer = nullptr;
+    }
+
+    /**
+     * @brief Destroy the EntityBuilder object
+     * 
+     * The components of a builder which was never built are destroyed.
+     * 
+     */
+    World::EntityBuilder::~EntityBuilder()
+    {
+        if (this->buffer == nullptr)
+            return;
+        for (auto &command : this->staged)
+            command.destroy(command.payload);
+        this->buffer->release();
     }
 
     /**
@@ -46,25 +87,104 @@ namespace ecs::world
      * @tparam T - The type of the component.
      * @param t - The component instance.
      * @return World::EntityBuilder& - This builder is returned.
+     * 
+     * @exception Throws a runtime exception if the Entity already has a T, or if the
+     *            builder has already been built.
      */
     template <class T>
-    World::EntityBuilder &World::EntityBuilder::with(T &&t)
+    World::EntityBuilder &World::EntityBuilder::with(T &&t) &
     {
-        RegistryNode *node = world_ptr->find<T>();
-        entity.add_component(world_ptr->get_cid<T>(), node->size<T>());
-        node->push<T>(std::move(t));
+        if (this->buffer == nullptr)
+            throw std::runtime_error("Cannot add a component to an Entity which has been built");
+
+        size_t cid = this->world_ptr->get_cid<T>();
+        if (this->components[cid])
+            throw std::runtime_error("Entity already has this component");
+        this->components[cid] = true;
+
+        T *payload = this->buffer->emplace<T>(std::move(t));
+        this->staged.push_back({0, cid, payload, &EntityBuilder::apply_spawn<T>, &ecs::command::destroy<T>});
         return *this;
     }
 
     /**
-     * @brief Finishes building the entity and destroys the builder.
+     * @brief Add a new component to a temporary EntityBuilder.
+     * 
+     * The builder is returned as an rvalue, so that it can be moved into a variable at
+     * the end of a chain of calls.
      * 
+     * @tparam T - The type of the component.
+     * @param t - The component instance.
+     * @return World::EntityBuilder&& - This builder is returned.
+     */
+    template <class T>
+    World::EntityBuilder &&World::EntityBuilder::with(T &&t) &&
+    {
+        this->with<T>(std::move(t));
+        return std::move(*this);
+    }
+
+    /**
+     * @brief Finishes building the entity.
+     * 
+     * @exception Throws a runtime exception if the builder has already been built.
      */
     void World::EntityBuilder::build()
     {
-        RegistryNode *node = world_ptr->find<Entity>();
-        entity.add_component(world_ptr->get_cid<Entity>(), node->size<Entity>());
-        world_ptr->add_entity(std::move(entity));
+        if (this->buffer == nullptr)
+            throw std::runtime_error("Entity has already been built");
+
+        // The header of the Entity, followed by a Command for each of its components.
+        ecs::command::Command header = {this->staged.size(), this->world_ptr->get_cid<Entity>(), nullptr, nullptr, nullptr};
+        if (this->world_ptr->dispatching)
+        {
+            this->buffer->push(ecs::command::Phase::Spawn, header);
+            for (auto &command : this->staged)
+                this->buffer->push(ecs::command::Phase::Spawn, command);
+            this->staged.clear();
+        }
+        else
+        {
+            std::vector<ecs::command::Command> commands;
+            commands.reserve(this->staged.size() + 1);
+            commands.push_back(header);
+            commands.insert(commands.end(), this->staged.begin(), this->staged.end());
+            // World::spawn() consumes every component, even if it throws.
+            this->staged.clear();
+            this->world_ptr->spawn(commands);
+        }
+
+        this->buffer->release();
+        this->buffer = nullptr;
+    }
+
+    /**
+     * @brief Moves a staged component into the World's storage.
+     * 
+     * The Entity has already been given an id, and with Archetype storage, a row. The
+     * staged component is destroyed, even if it can't be stored.
+     * 
+     * @tparam T - The type of the component.
+     * @param w - The World.
+     * @param command - The Spawn phase Command of the component.
+     */
+    template <class T>
+    void World::EntityBuilder::apply_spawn(World *w, const ecs::command::Command &command)
+    {
+        T *t = static_cast<T *>(command.payload);
+        try
+        {
+            if (w->storage == StorageMode::SparseSet)
+                w->nodes[command.cid].push<T>(command.eid, std::move(*t));
+            else
+                w->archetypes[w->locations[command.eid].archetype].column(command.cid)->append<T>(std::move(*t));
+        }
+        catch (...)
+        {
+            t->~T();
+            throw;
+        }
+        t->~T();
     }
 
     /**
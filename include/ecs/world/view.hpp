@@ -0,0 +1,609 @@
+#ifndef ecs_view_hpp
+#define ecs_view_hpp
+#include <ecs/world.hpp>
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <utility>
+#include <tuple>
+#include <vector>
+
+namespace ecs::world
+{
+    /**
+     * @brief A lazy range over the tuples of component pointers of matching Entities.
+     * 
+     * A View is returned by World::fetch(). Rather than building
+     * a vector of tuples up front, the matching Entities are found as the View is
+     * iterated, so fetching doesn't allocate. Each tuple is built when it's dereferenced.
+     * 
+     * The candidates are either every Entity (or Archetype), or the matches of a Query.
+     * Only the candidates which existed when the View was made are visited, so Entities
+     * built while iterating are not.
+     * 
+     * A View can be limited to the positions [first, last) of the iteration, where each
+     * candidate Entity, or each row of a candidate Archetype, is one position. This is
+     * used to split a fetch into chunks which can be iterated in parallel.
+     * 
+     * Safety:
+     *      A View refers to the storage of the World, so it must not be kept after the
+     *      World has merged the Commands of a dispatch.
+     * 
+     * @tparam Ts - The set of components to be fetched.
+     */
+    template <class... Ts>
+    class World::View
+    {
+    private:
+        World *world_ptr;
+        bitset view_mask;
+        const std::vector<size_t> *matches;
+        size_t n_candidates;
+        size_t first;
+        size_t last;
+
+    public:
+        using value_type = std::tuple<Ts *...>;
+        class Iterator;
+        struct Sentinel
+        {
+        };
+
+        View(World *world, bitset mask, const std::vector<size_t> *matches, size_t first = 0, size_t last = RegistryNode::npos);
+        ~View() = default;
+
+        Iterator begin();
+        Sentinel end() const;
+    };
+
+    /**
+     * @brief Iterator over the tuples of a View.
+     * 
+     * With SparseSet storage, the Iterator walks the Entities, and looks each component
+     * up in its ComponentPool. With Archetype storage, it walks the rows of each matching
+     * Archetype, and the ComponentPools of the Archetype's Columns are found once when
+     * the Iterator moves to the Archetype.
+     * 
+     */
+    template <class... Ts>
+    class World::View<Ts...>::Iterator
+    {
+    private:
+        View *view_ptr;
+        ComponentPool<Entity> entities;
+        std::tuple<ComponentPool<Ts>...> pools;
+        size_t candidate;
+        size_t row;
+        size_t n_rows;
+        size_t position;
+        size_t eid;
+        bool in_archetype;
+
+        void seek();
+        void advance();
+
+    public:
+        Iterator(View *view);
+        ~Iterator() = default;
+
+        value_type operator*();
+        Iterator &operator++();
+        bool operator==(const Sentinel &) const;
+        bool operator!=(const Sentinel &) const;
+    };
+
+    /**
+     * @brief Construct a new View object
+     * 
+     * @param world - The World the components are fetched from.
+     * @param mask - The components an Entity must have.
+     * @param matches - The matching Entity ids (SparseSet storage) or Archetype indices
+     *                  (Archetype storage) of a Query, or nullptr to visit every Entity.
+     * @param first - The first position to visit.
+     * @param last - The position to stop at.
+     */
+    template <class... Ts>
+    World::View<Ts...>::View(World *world, bitset mask, const std::vector<size_t> *matches, size_t first, size_t last)
+    {
+        this->world_ptr = world;
+        this->view_mask = mask;
+        this->matches = matches;
+        this->first = first;
+        this->last = last;
+
+        if (matches != nullptr)
+            this->n_candidates = matches->size();
+        else if (world->storage == StorageMode::Archetype)
+            this->n_candidates = world->archetypes.size();
+        else
+            this->n_candidates = world->find<Entity>()->template size<Entity>();
+
+        // With SparseSet storage every candidate is one position.
+        if (world->storage == StorageMode::SparseSet)
+            this->n_candidates = std::min(this->n_candidates, last);
+    }
+
+    /**
+     * @brief Getter function for an Iterator at the first match.
+     * 
+     * @return World::View<Ts...>::Iterator
+     */
+    template <class... Ts>
+    typename World::View<Ts...>::Iterator World::View<Ts...>::begin()
+    {
+        return Iterator(this);
+    }
+
+    /**
+     * @brief Getter function for the end of the View.
+     * 
+     * @return World::View<Ts...>::Sentinel
+     */
+    template <class... Ts>
+    typename World::View<Ts...>::Sentinel World::View<Ts...>::end() const
+    {
+        return Sentinel();
+    }
+
+    /**
+     * @brief Construct a new Iterator object at the first match of a View.
+     * 
+     * @param view - The View being iterated.
+     */
+    template <class... Ts>
+    World::View<Ts...>::Iterator::Iterator(View *view)
+    {
+        World *w = view->world_ptr;
+        this->view_ptr = view;
+        this->entities = w->find<Entity>()->template pool<Entity>();
+        if (w->storage == StorageMode::SparseSet)
+            this->pools = std::make_tuple(w->find<Ts>()->template pool<Ts>()...);
+        this->candidate = 0;
+        this->row = 0;
+        this->n_rows = 0;
+        this->position = 0;
+        this->eid = 0;
+        this->in_archetype = false;
+        this->seek();
+        this->advance();
+    }
+
+    /**
+     * @brief Moves the Iterator to the first position of the View.
+     * 
+     * With Archetype storage, the rows of the matching Archetypes before the first 
+     * position are skipped over without being visited.
+     * 
+     */
+    template <class... Ts>
+    void World::View<Ts...>::Iterator::seek()
+    {
+        View *view = this->view_ptr;
+        World *w = view->world_ptr;
+        this->position = view->first;
+
+        if (w->storage == StorageMode::SparseSet)
+        {
+            this->candidate = view->first;
+            return;
+        }
+
+        size_t skip = view->first;
+        for (; this->candidate < view->n_candidates; this->candidate++)
+        {
+            size_t idx = view->matches != nullptr ? (*view->matches)[this->candidate] : this->candidate;
+            auto &archetype = w->archetypes[idx];
+            if (!archetype.matches(view->view_mask))
+                continue;
+            if (skip < archetype.size())
+            {
+                this->pools = std::make_tuple(w->archetype_pool<Ts>(archetype)...);
+                this->n_rows = archetype.size();
+                this->row = skip;
+                this->in_archetype = true;
+                return;
+            }
+            skip -= archetype.size();
+        }
+    }
+
+    /**
+     * @brief Moves the Iterator forwards to the next match, starting from where it is.
+     * 
+     */
+    template <class... Ts>
+    void World::View<Ts...>::Iterator::advance()
+    {
+        View *view = this->view_ptr;
+        World *w = view->world_ptr;
+
+        if (w->storage == StorageMode::SparseSet)
+        {
+            // Every match of a Query has the components, so only the Entities of a plain
+            // fetch have to be checked.
+            if (view->matches != nullptr)
+            {
+                if (this->candidate < view->n_candidates)
+                    this->eid = (*view->matches)[this->candidate];
+                return;
+            }
+
+            for (; this->candidate < view->n_candidates; this->candidate++)
+            {
+                Entity *e = this->entities.get(this->candidate);
+                if (e->has_component(view->view_mask))
+                {
+                    this->eid = e->eid();
+                    return;
+                }
+            }
+            return;
+        }
+
+        while (this->candidate < view->n_candidates)
+        {
+            size_t idx = view->matches != nullptr ? (*view->matches)[this->candidate] : this->candidate;
+            auto &archetype = w->archetypes[idx];
+            if (!this->in_archetype)
+            {
+                if (!archetype.matches(view->view_mask))
+                {
+                    this->candidate++;
+                    continue;
+                }
+                this->pools = std::make_tuple(w->archetype_pool<Ts>(archetype)...);
+                this->n_rows = archetype.size();
+                this->row = 0;
+                this->in_archetype = true;
+            }
+
+            for (; this->row < this->n_rows; this->row++, this->position++)
+            {
+                if (this->position >= view->last)
+                {
+                    this->candidate = view->n_candidates;
+                    return;
+                }
+                this->eid = archetype.eid_at(this->row);
+                return;
+            }
+
+            this->candidate++;
+            this->in_archetype = false;
+        }
+    }
+
+    /**
+     * @brief Builds the tuple of component pointers of the current match.
+     * 
+     * @return World::View<Ts...>::value_type
+     */
+    template <class... Ts>
+    typename World::View<Ts...>::value_type World::View<Ts...>::Iterator::operator*()
+    {
+        size_t row = this->row;
+        size_t eid = this->eid;
+        return std::apply([row, eid](auto &... pool) { return std::make_tuple(pool.fetch(row, eid)...); }, this->pools);
+    }
+
+    /**
+     * @brief Moves the Iterator to the next match.
+     * 
+     * @return World::View<Ts...>::Iterator&
+     */
+    template <class... Ts>
+    typename World::View<Ts...>::Iterator &World::View<Ts...>::Iterator::operator++()
+    {
+        if (this->in_archetype)
+        {
+            this->row++;
+            this->position++;
+        }
+        else
+        {
+            this->candidate++;
+        }
+        this->advance();
+        return *this;
+    }
+
+    /**
+     * @brief Checks if every match has been visited.
+     * 
+     * @return true
+     * @return false
+     */
+    template <class... Ts>
+    bool World::View<Ts...>::Iterator::operator==(const Sentinel &) const
+    {
+        return this->candidate >= this->view_ptr->n_candidates;
+    }
+
+    /**
+     * @brief Checks if there are matches left to visit.
+     * 
+     * @return true
+     * @return false
+     */
+    template <class... Ts>
+    bool World::View<Ts...>::Iterator::operator!=(const Sentinel &s) const
+    {
+        return !(*this == s);
+    }
+
+    /**
+     * @brief Fetches the tuples of pointers to components for systems to iterate over.
+     * 
+     * Systems work on a set of components <A, B, ...>, and are intended to run over a
+     * tuple of component pointers <A*, B*, ...>, where each element in the tuple belongs
+     * to a single Entity. This function returns a View which finds these tuples as it is
+     * iterated over.
+     * 
+     * Entities removed by a System are still visited until the Commands of the dispatch
+     * are merged, when they are removed from the World.
+     * 
+     * @tparam Ts - The set of components to be fetched.
+     * @return World::View<Ts...>
+     */
+    template <class... Ts>
+    World::View<Ts...> World::fetch()
+    {
+        return View<Ts...>(this, this->mask<Ts...>(), nullptr);
+    }
+
+    /**
+     * @brief Fetches the tuples of pointers to components.
+     * 
+     * This is the same as World::fetch<Ts...>(). Removed Entities no longer have to be
+     * destroyed through fetches, so fetching from inside a System's run function is
+     * always safe. It is kept for existing Systems which use it.
+     * 
+     * @tparam Ts - The set of components to be fetched.
+     * @return World::View<Ts...>
+     */
+    template <class... Ts>
+    World::View<Ts...> World::safe_fetch()
+    {
+        return View<Ts...>(this, this->mask<Ts...>(), nullptr);
+    }
+
+    /**
+     * @brief Fetches the tuples of pointers to components from a Query.
+     * 
+     * This behaves the same as World::fetch<Ts...>(), but only visits the Entities
+     * matched by the Query.
+     * 
+     * @tparam Ts - The set of components to be fetched.
+     * @param query - A Query made by this World.
+     * @return World::View<Ts...>
+     */
+    template <class... Ts>
+    World::View<Ts...> World::fetch(ecs::query::Query<Ts...> &query)
+    {
+        ecs::query::QueryState *state = query.state();
+        if (this->storage == StorageMode::Archetype)
+            return View<Ts...>(this, state->mask(), &state->matched_archetypes());
+        return View<Ts...>(this, state->mask(), &state->matched_entities());
+    }
+
+    /**
+     * @brief Fetches the tuples of pointers to components from part of a Query.
+     * 
+     * Only the positions [first, last) of the Query's matches are visited, out of the
+     * World::count() positions of the Query. Each chunk of the matches can be fetched
+     * separately, and iterated in parallel with the others.
+     * 
+     * @tparam Ts - The set of components to be fetched.
+     * @param query - A Query made by this World.
+     * @param first - The first position to visit.
+     * @param last - The position to stop at.
+     * @return World::View<Ts...>
+     */
+    template <class... Ts>
+    World::View<Ts...> World::fetch(ecs::query::Query<Ts...> &query, size_t first, size_t last)
+    {
+        ecs::query::QueryState *state = query.state();
+        if (this->storage == StorageMode::Archetype)
+            return View<Ts...>(this, state->mask(), &state->matched_archetypes(), first, last);
+        return View<Ts...>(this, state->mask(), &state->matched_entities(), first, last);
+    }
+
+    /**
+     * @brief Calls a function with each run of a Query's matches whose components are
+     * contiguous.
+     * 
+     * The function is called as f(n, Ts *...), where each pointer is the first of n 
+     * components in a row, and the ith component of every array belongs to the same
+     * Entity. Every match of the Query is in exactly one run.
+     * 
+     * With Archetype storage, each matching Archetype is one run. With SparseSet 
+     * storage, a run is a stretch of matches whose components are next to each other in
+     * every RegistryNode, which is the case for Entities spawned together, e.g. with 
+     * spawn_batch().
+     * 
+     * @tparam Ts - The components of the Query.
+     * @tparam F - A callable taking (size_t, Ts *...).
+     * @param query - A Query made by this World.
+     * @param f - Called once for each run.
+     * 
+     * @exception Throws a runtime exception if one of the components is a resource or
+     * the Entity component, or is stored as SoA.
+     */
+    template <class... Ts, class F>
+    void World::for_each_batch(ecs::query::Query<Ts...> &query, F f)
+    {
+        for (RegistryNode *node : {this->find<Ts>()...})
+        {
+            if (node->is_resource() || node == this->find<Entity>())
+                throw std::runtime_error("Only components can be iterated in batches");
+            if (node->get_layout() != Layout::AoS)
+                throw std::runtime_error("Components stored as SoA can't be iterated in batches");
+        }
+
+        ecs::query::QueryState *state = query.state();
+        if (this->storage == StorageMode::Archetype)
+        {
+            for (size_t idx : state->matched_archetypes())
+            {
+                auto &archetype = this->archetypes[idx];
+                if (archetype.size() > 0)
+                    f(archetype.size(), this->archetype_pool<Ts>(archetype).data()...);
+            }
+            return;
+        }
+
+        this->sparse_batches<Ts...>(state->matched_entities(), f, std::index_sequence_for<Ts...>());
+    }
+
+    /**
+     * @brief Splits the matches of a Query into runs, with SparseSet storage.
+     * 
+     * A run starts at a match, and grows while the next element of every RegistryNode 
+     * belongs to the next match. The dense arrays of Entity ids are compared with the
+     * matches a RegistryNode at a time, so long runs are found without looking each
+     * match up.
+     * 
+     * @tparam Ts - The components of the Query.
+     * @tparam F - A callable taking (size_t, Ts *...).
+     * @param matches - The matching Entity ids.
+     * @param f - Called once for each run.
+     */
+    template <class... Ts, class F, size_t... Is>
+    void World::sparse_batches(const std::vector<size_t> &matches, F &f, std::index_sequence<Is...>)
+    {
+        std::array<RegistryNode *, sizeof...(Ts)> nodes = {this->find<Ts>()...};
+        std::array<const std::vector<size_t> *, sizeof...(Ts)> eids = {&this->find<Ts>()->eids()...};
+        auto pools = std::make_tuple(this->find<Ts>()->template pool<Ts>()...);
+        std::array<size_t, sizeof...(Ts)> first;
+
+        for (size_t j = 0; j < matches.size();)
+        {
+            size_t n = matches.size() - j;
+            for (size_t k = 0; k < nodes.size(); k++)
+            {
+                // The run can't be longer than the elements left in any RegistryNode.
+                first[k] = nodes[k]->index_of(matches[j]);
+                const size_t *ids = eids[k]->data() + first[k];
+                size_t limit = std::min(n, eids[k]->size() - first[k]);
+                size_t m = 1;
+                while (m < limit && ids[m] == matches[j + m])
+                    m++;
+                n = m;
+            }
+            f(n, (std::get<Is>(pools).data() + first[Is])...);
+            j += n;
+        }
+    }
+
+    /**
+     * @brief Counts the positions a fetch of a Query iterates over.
+     * 
+     * This is the number of matched Entities.
+     * 
+     * @tparam Ts - The set of components of the Query.
+     * @param query - A Query made by this World.
+     * @return size_t 
+     */
+    template <class... Ts>
+    size_t World::count(ecs::query::Query<Ts...> &query)
+    {
+        ecs::query::QueryState *state = query.state();
+        if (this->storage == StorageMode::SparseSet)
+            return state->matched_entities().size();
+
+        size_t n = 0;
+        for (size_t idx : state->matched_archetypes())
+            n += this->archetypes[idx].size();
+        return n;
+    }
+
+    /**
+     * @brief Removes every Entity with the components Ts for which a predicate is true.
+     * 
+     * From within a System, the Entities are removed when the Commands are merged,
+     * like WorldResource::remove_entity(). Otherwise they are removed straight away.
+     * 
+     * @tparam Ts - The components given to the predicate.
+     * @tparam F - A callable taking (Ts *...) and returning a bool.
+     * @param predicate - Called once for each Entity with the components Ts.
+     * @return size_t - The number of Entities removed.
+     */
+    template <class... Ts, class F>
+    size_t World::despawn_where(F predicate)
+    {
+        std::vector<Entity *> doomed;
+        for (auto t : this->fetch<Entity, Ts...>())
+        {
+            if (std::apply([&predicate](Entity *, Ts *... components) { return predicate(components...); }, t))
+                doomed.push_back(std::get<0>(t));
+        }
+
+        if (this->dispatching)
+        {
+            WorldResource *world_res = this->find<WorldResource>()->template get<WorldResource>(0);
+            for (Entity *e : doomed)
+                world_res->remove_entity(e);
+            return doomed.size();
+        }
+
+        // Removing an Entity moves others, so the ids are taken before any are removed.
+        std::vector<size_t> eids;
+        eids.reserve(doomed.size());
+        for (Entity *e : doomed)
+            eids.push_back(e->eid());
+        for (size_t eid : eids)
+            this->erase_entity(eid);
+        return eids.size();
+    }
+
+    /**
+     * @brief Calls a kernel once for each contiguous chunk of the components Ts.
+     * 
+     * The kernel is called as f(n, ComponentPool<Ts> &...), where each pool holds the
+     * n components of the chunk in the same order, so the ith element of every pool 
+     * belongs to the same Entity. Components stored as SoA are reached through 
+     * ComponentPool::columns(), and the others through ComponentPool::data(), which 
+     * lets the kernel loop over plain arrays.
+     * 
+     * With Archetype storage, each matching Archetype is one chunk. With SparseSet 
+     * storage the components of different types aren't in the same order, so only a
+     * single component can be iterated, as one chunk.
+     * 
+     * @tparam Ts - The components of the chunks.
+     * @tparam F - A callable taking (size_t, ComponentPool<Ts> &...).
+     * @param f - The kernel.
+     * 
+     * @exception Throws a runtime exception if more than one component is iterated with
+     * SparseSet storage.
+     */
+    template <class... Ts, class F>
+    void World::for_each_chunk(F f)
+    {
+        if (this->storage == StorageMode::SparseSet)
+        {
+            if constexpr (sizeof...(Ts) == 1)
+            {
+                ComponentPool<Ts...> pool = this->find<Ts...>()->template pool<Ts...>();
+                if (pool.size() > 0)
+                    f(pool.size(), pool);
+                return;
+            }
+            else
+            {
+                throw std::runtime_error("Chunks of more than one component need Archetype storage");
+            }
+        }
+
+        bitset m = this->mask<Ts...>();
+        for (auto &archetype : this->archetypes)
+        {
+            if (archetype.size() == 0 || !archetype.matches(m))
+                continue;
+            auto pools = std::make_tuple(this->archetype_pool<Ts>(archetype)...);
+            std::apply([&f, &archetype](auto &... pool) { f(archetype.size(), pool...); }, pools);
+        }
+    }
+
+} // namespace ecs::world
+
+#endif
@@ -15,6 +15,9 @@ namespace ecs::world
      * is used. Components can easily be registered by using .with_component<T>()
      * Upon calling .build() the World has been defined and is returned.
      * 
+     * The way components are stored can be chosen with .with_storage(). Systems don't
+     * depend on the storage, so the same systems can be run on either.
+     * 
      */
     class World::WorldBuilder
     {
@@ -28,22 +31,33 @@ namespace ecs::world
         WorldBuilder(WorldBuilder &&) = default;
 
         template <class T>
-        WorldBuilder &with_component();
+        WorldBuilder &with_component(Layout layout = Layout::AoS);
         template <class T>
         WorldBuilder &add_resource(T &&t);
+        WorldBuilder &with_storage(StorageMode mode);
+        WorldBuilder &with_threads(size_t n_threads);
         World build();
     };
 
     /**
      * @brief Registers a component T to the World being built.
      * 
+     * A plain numeric component whose fields are declared with ecs::soa::Fields can be
+     * stored as Layout::SoA, with each field in its own aligned column. Loops over one
+     * field, or kernels run with World::for_each_chunk(), then only touch the columns 
+     * they use.
+     * 
      * @tparam T - The component to be registered
+     * @param layout - How the components are laid out in memory. Layout::AoS by default.
      * @return World::WorldBuilder& - This WorldBuilder
+     * 
+     * @exception Throws a runtime exception if the layout is SoA, and the fields of T
+     * haven't been declared with ecs::soa::Fields.
      */
     template <class T>
-    World::WorldBuilder &World::WorldBuilder::with_component()
+    World::WorldBuilder &World::WorldBuilder::with_component(Layout layout)
     {
-        world.register_component<T>();
+        world.register_component<T>(layout);
         return *this;
     }
 
@@ -62,21 +76,65 @@ namespace ecs::world
         return *this;
     }
 
+    /**
+     * @brief Chooses how the components of the World being built are stored.
+     * 
+     * @param mode - The StorageMode. StorageMode::SparseSet is used by default.
+     * @return World::WorldBuilder& - This WorldBuilder
+     */
+    World::WorldBuilder &World::WorldBuilder::with_storage(StorageMode mode)
+    {
+        world.storage = mode;
+        return *this;
+    }
+
+    /**
+     * @brief Chooses how many worker threads the World uses to run Systems.
+     * 
+     * The thread calling World::dispatch() runs Systems as well, so by default one less
+     * than the number of hardware threads are started. With 0, every System is run on
+     * the calling thread.
+     * 
+     * @param n_threads - The number of worker threads.
+     * @return World::WorldBuilder& - This WorldBuilder
+     */
+    World::WorldBuilder &World::WorldBuilder::with_threads(size_t n_threads)
+    {
+        world.n_threads = n_threads;
+        return *this;
+    }
+
     /**
      * @brief Finishes building the world.
      * 
      * @return World - The built world.
+     * 
+     * @exception Throws a runtime exception if more than ECS_MAX_COMPONENTS components
+     * and resources have been registered.
      */
     World World::WorldBuilder::build()
     {
-        world.component_mask = ecs::entity::bitset(world.count_components());
+        if (world.count_components() > ECS_MAX_COMPONENTS)
+            throw std::runtime_error("Too many components registered. Define ECS_MAX_COMPONENTS to allow more");
+
+        world.component_mask = ecs::entity::bitset();
         int i = 0;
-        for (auto node : world.nodes)
+        for (auto &node : world.nodes)
         {
             if (!node.is_resource())
                 world.component_mask.set(i);
             i++;
         }
+
+        // Every Entity starts in the Archetype which only has the Entity component.
+        if (world.storage == StorageMode::Archetype)
+        {
+            ecs::entity::bitset root;
+            root.set(world.get_cid<Entity>());
+            world.archetypes.push_back(ecs::archetype::Archetype(root));
+        }
+
+        world.workers = std::make_unique<ecs::thread_pool::ThreadPool>(world.n_threads);
         return std::move(world);
     }
 
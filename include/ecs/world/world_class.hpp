@@ -1,78 +1,260 @@
 #ifndef ecs_world_class_hpp
 #define ecs_world_class_hpp
 #include <iostream>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <exception>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <queue>
 #include <vector>
 #include <tuple>
 #include <ecs/registry.hpp>
 #include <ecs/entity.hpp>
+#include <ecs/archetype.hpp>
+#include <ecs/query.hpp>
+#include <ecs/thread_pool.hpp>
+#include <ecs/command.hpp>
+#include <ecs/trace.hpp>
 #include <string>
 #include <iostream>
 #include <thread>
-#include <functional>
 #include <algorithm>
-#include <mutex>
 
 using ecs::entity::bitset;
 using ecs::entity::Entity;
+using ecs::entity::EntityHandle;
+using ecs::registry::ComponentPool;
+using ecs::registry::ComponentRef;
+using ecs::registry::Layout;
 using ecs::registry::RegistryNode;
 
+namespace ecs::world
+{
+    class World;
+} // namespace ecs::world
+
 namespace ecs::dispatch
 {
-    class Executable;
 
-    /*!
-     * @typedef std::Vector<Executable *> $DispatcherStage
-     * A container for Executables which can be run in parallel
+    /**
+     * @brief The components and resources an Executable reads and writes.
+     * 
+     * Any number of Executables may read the same component at once, but an Executable
+     * which writes a component must not run at the same time as any other Executable
+     * which reads or writes it. An Executable which may make Commands through the
+     * WorldResource must have them merged before its dependents run.
+     * 
+     */
+    struct Access
+    {
+        bitset reads;
+        bitset writes;
+        bool exclusive = false;
+        bool commands = false;
+
+        bool conflicts(const Access &other) const;
+    };
+
+    /**
+     * @brief Checks if two Executables can't safely run at the same time.
+     * 
+     * @param other - The Access of the other Executable.
+     * @return true
+     * @return false
+     */
+    bool Access::conflicts(const Access &other) const
+    {
+        if (this->exclusive || other.exclusive)
+            return true;
+        return (this->writes & (other.reads | other.writes)).any() || (other.writes & this->reads).any();
+    }
+
+    /**
+     * @brief Executables are an abstarct class which defines an exec function
+     * 
+     * The idea behind this is that Systems require a parameter pack, thus Systems which
+     * require different parameter types, cannot be stored in a container (easily). 
+     * 
+     * Regardless of the parameters the Systems use, the functionality to fetch and run
+     * each system can be abstracted away into a single exec() function. That is what 
+     * this abstract class provides. Now, a dispatcher can be a container of Executable*
+     * and call the exec() function as defined by the System class, meaning the user does
+     * not have to do any additional implementation beyond the System::run() function. 
+     * 
+     * When an Executable is added to a World, setup() is called once so that it can 
+     * prepare anything it needs from the World, such as its Query.
+     * 
+     * An Executable declares which components and resources it reads and writes with
+     * access(), which the dispatcher uses to keep conflicting Executables apart. An
+     * Executable which doesn't declare its access conflicts with every other one.
+     * 
+     */
+    class Executable
+    {
+    public:
+        virtual void setup(ecs::world::World *) {}
+        virtual void exec(ecs::world::World *) = 0;
+        virtual Access access(ecs::world::World *) const;
+    };
+
+    /**
+     * @brief Default access of an Executable, which conflicts with everything.
+     * 
+     * @return Access
+     */
+    Access Executable::access(ecs::world::World *) const
+    {
+        Access all;
+        all.exclusive = true;
+        all.commands = true;
+        return all;
+    }
+
+    /**
+     * @brief A System in the dependency graph of a World.
+     * 
+     * A node can only run once each of its dependencies has finished. When it finishes,
+     * the number of dependencies left of each of its successors is decremented.
+     * 
+     * The cost of a node is a moving average of how long its System took to run, in
+     * nanoseconds. Its priority is the cost of the longest chain of Systems starting at
+     * the node, as of the last time the graph was planned.
+     * 
      */
-    typedef std::vector<Executable *> DispatcherStage;
+    struct DispatcherNode
+    {
+        std::string name;
+        Executable *system;
+        std::vector<size_t> successors;
+        size_t n_dependencies;
+        bool main_thread;
+        bool commands;
+        double cost = 0;
+        double planned_cost = 0;
+        double priority = 0;
+
+        void record_cost(double ns);
+    };
+
     /*!
-     * \typedef std::vector<DispatcherStage> DispatcherContainer
-     * A container of DispatcherStages to be run in order.
+     * \typedef std::vector<DispatcherNode> DispatcherContainer
+     * The dependency graph of the Systems of a World. A node only has successors after
+     * it, so running the nodes in order respects every dependency.
+     */
+    typedef std::vector<DispatcherNode> DispatcherContainer;
+
+    // The weight of the newest run time in the cost of a node.
+    constexpr double COST_SMOOTHING = 0.2;
+    // How far the cost of a node can move, relative to its planned cost, before the
+    // graph is planned again. Costs below MIN_PLANNED_COST are treated as that cost, so
+    // that the jitter of trivial Systems doesn't cause planning.
+    constexpr double REPLAN_THRESHOLD = 0.25;
+    constexpr double MIN_PLANNED_COST = 1000.0;
+
+    /**
+     * @brief Adds the time the System took to run to the cost of the node.
+     * 
+     * @param ns - The run time in nanoseconds.
+     */
+    void DispatcherNode::record_cost(double ns)
+    {
+        if (this->cost == 0)
+            this->cost = ns;
+        else
+            this->cost += COST_SMOOTHING * (ns - this->cost);
+    }
+
+    /**
+     * @brief Checks if the cost of any node has moved far enough to plan the graph again.
+     * 
+     * @param nodes - The dependency graph.
+     * @return true
+     * @return false
+     */
+    bool costs_changed(const DispatcherContainer &nodes)
+    {
+        for (auto &node : nodes)
+        {
+            double change = node.cost > node.planned_cost ? node.cost - node.planned_cost : node.planned_cost - node.cost;
+            if (change > REPLAN_THRESHOLD * std::max(node.planned_cost, MIN_PLANNED_COST))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Sets the priority of each node to the cost of its critical path.
+     * 
+     * When more Systems are ready than there are threads, the System with the most
+     * costly chain of work after it is run first, since it bounds how soon the dispatch
+     * can finish. Successors always come after a node, so a single backwards pass finds
+     * every priority.
+     * 
+     * @param nodes - The dependency graph.
      */
-    typedef std::vector<DispatcherStage> DispatcherContainer;
+    void plan(DispatcherContainer &nodes)
+    {
+        for (size_t i = nodes.size(); i-- > 0;)
+        {
+            double longest = 0;
+            for (size_t next : nodes[i].successors)
+                longest = std::max(longest, nodes[next].priority);
+            nodes[i].planned_cost = nodes[i].cost;
+            nodes[i].priority = nodes[i].cost + longest;
+        }
+    }
 
     /**
-     * @brief Class to build a DispatcherContainer based on user described dependencies
+     * @brief Class to build a DispatcherContainer from the access and dependencies of Systems
      * 
-     * Dependencies MUST be programmer defined. This is required to allow the programmer
-     * to specify the order in which systems are run, even if the signature is mutually
-     * exclusive. 
+     * Systems declare which components they read (const T) and write (T). When a System
+     * is added, it is made to depend on every System added before it which it conflicts
+     * with, so Systems which write the same component run in the order they were added,
+     * while Systems which only read it can run in parallel.
      * 
-     * It is the PROGRAMMER'S responsibility to ensure that they do not introduce data
-     * races. Systems with one or more shared component signatures MUST have a dependency
-     * relationship, either directly or indirectly.
+     * Dependencies can also be programmer defined. This is required to order systems 
+     * which don't share any components, but which still depend on each other, such as
+     * Systems which draw to the screen, and Systems which fetch other components through
+     * the WorldResource, since only the parameters of a System are known here.
      * 
-     * The resuting DispatcherContainer is built using a BFS Topological sort.
+     * Systems which must run on the thread calling World::dispatch(), such as Systems
+     * which use a graphics context, are added with add_main_thread_system().
      * 
      * Example: 
-     *  Consider the following Systems:
-     *      System A<Com_1, Com_2>
-     *      System B<Com_2>
-     *      System C<Com_1>
-     * 
-     *  Systems B and C both share a component signature with System A, thus there must 
-     *  be a defined order. 
+     *  Consider the following Systems, added in this order:
+     *      System A<Com_1, const Com_2>
+     *      System B<const Com_2>
+     *      System C<const Com_1>
      * 
-     *  Dependencies can be defined directly:
-     *      [ B, C ] -> [ A ] (A depends on both B, C. B & C can be run in parallel safely.)
-     *  or indirectly:
-     *      [ A ] -> [ B ] -> [ C ] (C depends on B, which depends on A) 
+     *  A and B only read Com_2, so they don't conflict. C reads Com_1, which A writes, so
+     *  C depends on A:
+     *      A -> C
+     *      B
      * 
      */
     class DispatcherContainerBuilder
     {
     private:
-        std::unordered_map<std::string, uint> counts;
         std::unordered_map<std::string, std::vector<std::string>> edges;
         std::unordered_map<std::string, Executable *> systems;
+        std::unordered_map<std::string, bool> main_thread;
+        std::vector<std::pair<std::string, Access>> accesses;
         DispatcherContainer *container_ref;
+        ecs::world::World *world_ptr;
 
     public:
-        DispatcherContainerBuilder(DispatcherContainer *ref) { this->container_ref = ref; };
+        DispatcherContainerBuilder(DispatcherContainer *ref, ecs::world::World *world)
+        {
+            this->container_ref = ref;
+            this->world_ptr = world;
+        };
         ~DispatcherContainerBuilder() = default;
 
         DispatcherContainerBuilder &add_system(Executable *exe_ptr, const std::string exe_name, std::initializer_list<std::string> deps);
+        DispatcherContainerBuilder &add_main_thread_system(Executable *exe_ptr, const std::string exe_name, std::initializer_list<std::string> deps);
         void done();
     };
 
@@ -83,6 +265,9 @@ namespace ecs::dispatch
      * dependencies have already been defined. If a dependency is not found, a runtime
      * error is thrown. This is sufficient to ensure that the dependency graph is acyclic.
      * 
+     * The System is set up for the World here, which registers its Query. The System
+     * also depends on every System added before it which it conflicts with.
+     * 
      * @param exe_ptr   The System pointer
      * @param exe_name  A unique identifier for the system. Used to specify dependencies
      * @param deps      A list of dependencies.     
@@ -93,91 +278,111 @@ namespace ecs::dispatch
         const std::string exe_name,
         std::initializer_list<std::string> deps)
     {
-        this->systems[exe_name] = exe_ptr;
-        this->edges[exe_name] = std::vector<std::string>();
-        this->counts[exe_name] = 0;
+        exe_ptr->setup(this->world_ptr);
+        auto &exe_edges = this->edges[exe_name];
         for (auto dep : deps)
         {
-            this->edges[exe_name].push_back(dep);
-            if (this->counts.find(dep) == this->counts.end())
+            if (this->systems.find(dep) == this->systems.end())
                 throw std::runtime_error("Dependency not found");
-            this->counts[dep]++;
+            exe_edges.push_back(dep);
         }
+        this->systems[exe_name] = exe_ptr;
+        this->main_thread[exe_name] = false;
+
+        Access access = exe_ptr->access(this->world_ptr);
+        for (auto &other : this->accesses)
+        {
+            if (!access.conflicts(other.second))
+                continue;
+            if (std::find(exe_edges.begin(), exe_edges.end(), other.first) != exe_edges.end())
+                continue;
+            exe_edges.push_back(other.first);
+        }
+        this->accesses.push_back(std::make_pair(exe_name, access));
         return *this;
     }
 
     /**
-     * @brief Finish specifying systems to add to the Dispatcher.
-     * 
-     * The DispatcherContainer is built using a BFS Topological sort. The algorithm works
-     * as follows:
-     *  
-     *  1) Find all Verticies with an 'in degree' of 0
-     *  2) Add each of the found Verticies to the next 'Stage'.
-     *  3) Remove each found Vertex from the graph.
-     *  4) Repeat steps 1-3 until the graph is empty. 
+     * @brief Adds a System which is only ever run by the thread calling World::dispatch().
      * 
-     * An additional check to ensure that the graph is acyclic is done. If there are no
-     * found Verticies with an 'in degree' of 0 AND the graph isn't empty, then there is
-     * a cycle in the graph. In this situation a runtime error is thrown. 
+     * @param exe_ptr   The System pointer
+     * @param exe_name  A unique identifier for the system. Used to specify dependencies
+     * @param deps      A list of dependencies.
+     * @return DispatcherContainerBuilder& 
+     */
+    DispatcherContainerBuilder &DispatcherContainerBuilder::add_main_thread_system(
+        Executable *exe_ptr,
+        const std::string exe_name,
+        std::initializer_list<std::string> deps)
+    {
+        this->add_system(exe_ptr, exe_name, deps);
+        this->main_thread[exe_name] = true;
+        return *this;
+    }
+
+    /**
+     * @brief Finish specifying systems to add to the Dispatcher.
      * 
-     * Since the dependencies are defined 'bottom up', this topological sort will find
-     * the systems to execute last first. Since building this DispatcherContainer is to
-     * be done once per world, the execution time isn't super critical. As such I'm using
-     * the costly 'insert' to put each stage before the last, such that the 
-     * DispatcherContainer order makes sense. If this is deemed unnessisary, container 
-     * can be iterated in reverse.
+     * A node is made for each System, in the order they were added. Since a System can
+     * only depend on Systems added before it, the graph is acyclic, and every node comes
+     * after its dependencies. The nodes are appended to any nodes added by an earlier
+     * builder.
      * 
      */
     void DispatcherContainerBuilder::done()
     {
-        while (!this->systems.empty())
+        size_t first = this->container_ref->size();
+        std::unordered_map<std::string, size_t> indices;
+        for (auto &exe : this->accesses)
         {
-            // Add empty stage
-            ecs::dispatch::DispatcherStage stage;
-
-            // Find all keys with out degree 0
-            std::vector<std::string> in_degree_zero_keys;
-            for (auto key : this->counts)
-            {
-                if (key.second == 0)
-                    in_degree_zero_keys.push_back(key.first);
-            }
-
-            // Remove the keys from counts.
-            for (auto key : in_degree_zero_keys)
-                this->counts.erase(key);
-
-            // Check for cycles - Kept as a failsafe.
-            if (in_degree_zero_keys.size() == 0 && !this->systems.empty())
-                throw std::runtime_error("Detected cycle in dependency graph!");
-
-            // Remove the systems with in degree 0
-            for (auto key : in_degree_zero_keys)
-            {
-                // Decrease the in degree of each element pointed by key
-                for (auto edge : this->edges[key])
-                {
-                    this->counts[edge]--;
-                }
+            indices[exe.first] = this->container_ref->size();
+            ecs::dispatch::DispatcherNode node;
+            node.name = exe.first;
+            node.system = this->systems[exe.first];
+            node.n_dependencies = this->edges[exe.first].size();
+            node.main_thread = this->main_thread[exe.first];
+            node.commands = exe.second.commands;
+            this->container_ref->push_back(node);
+        }
 
-                // Remove the key
-                this->edges.erase(key);
-                // Remove the system from the graph, and add it to the stage.
-                stage.push_back(this->systems[key]);
-                this->systems.erase(key);
-            }
+        for (auto &exe : this->accesses)
+        {
+            for (auto &dep : this->edges[exe.first])
+                (*this->container_ref)[indices[dep]].successors.push_back(indices[exe.first]);
+        }
 
-            // Insert the stage into the dependency graph.
-            container_ref->insert(container_ref->begin(), stage);
+        // Keep the successors in the order the Systems were added.
+        for (size_t i = first; i < this->container_ref->size(); i++)
+        {
+            auto &successors = (*this->container_ref)[i].successors;
+            std::sort(successors.begin(), successors.end());
         }
+        ecs::dispatch::plan(*this->container_ref);
     }
 } // namespace ecs::dispatch
 
 namespace ecs::world
 {
 
-    class World;
+    /**
+     * @brief How the components of Entities are stored in a World.
+     * 
+     * SparseSet:
+     *      Every component type has its own RegistryNode, which is a sparse set over the
+     *      Entity ids. This is the default.
+     * 
+     * Archetype:
+     *      Entities with the same set of components are stored together in an
+     *      ecs::archetype::Archetype table, with one Column per component. Fetching
+     *      only visits the tables which match, and iterates their Columns linearly, at
+     *      the cost of moving an Entity's components whenever a component is added or
+     *      removed.
+     */
+    enum class StorageMode
+    {
+        SparseSet,
+        Archetype,
+    };
 
     /**
      * @brief A wrapper around a World* for use as a resource.
@@ -195,10 +400,14 @@ namespace ecs::world
     {
     private:
         World *world_ptr;
-        std::mutex mutex_guard;
-        // Vector of <CID, IDX, Function>
-        std::vector<std::tuple<size_t, size_t, std::function<void()>>> remove_functions;
-        std::vector<std::function<void()>> add_functions;
+        // One CommandBuffer per thread which can run Systems.
+        std::vector<std::unique_ptr<ecs::command::CommandBuffer>> buffers;
+
+        template <class T>
+        static void apply_add(World *w, const ecs::command::Command &command);
+        template <class T>
+        static void apply_remove(World *w, const ecs::command::Command &command);
+        static void apply_despawn(World *w, const ecs::command::Command &command);
 
     public:
         WorldResource(World *world_pointer);
@@ -209,13 +418,11 @@ namespace ecs::world
         void remove_entity_component(Entity *);
         template <class T>
         void add_component_to_entity(Entity *, T &&t);
-        template <class... Ts>
-        void invalidate_entity_components(Entity *e);
-        template <class T>
-        void invalidate_entity_component(Entity *e);
         void remove_entity(Entity *);
-        void stage_entity_for_removal(Entity *e);
+        void reserve_buffers(size_t n_threads);
+        ecs::command::CommandBuffer &local_buffer();
         void merge();
+        bool has_commands() const;
         World *world() { return this->world_ptr; }
     };
 
@@ -229,34 +436,71 @@ namespace ecs::world
     class World
     {
     private:
-        size_t next_eid;
+        std::vector<uint32_t> generations;
+        std::vector<uint32_t> free_eids;
         std::vector<RegistryNode> nodes;
-        std::unordered_map<size_t, size_t> node_index_lookup;
+        std::vector<size_t> type_to_node;
         ecs::dispatch::DispatcherContainer systems;
         ecs::entity::bitset component_mask;
+        StorageMode storage;
+        std::vector<ecs::archetype::Archetype> archetypes;
+        std::vector<ecs::archetype::EntityLocation> locations;
+        std::vector<std::unique_ptr<ecs::query::QueryState>> queries;
+        size_t n_threads;
+        std::unique_ptr<ecs::thread_pool::ThreadPool> workers;
+        std::unique_ptr<ecs::trace::Tracer> tracer_ptr;
+        bool dispatching;
 
         template <class T>
-        void register_component();
+        void register_component(Layout layout = Layout::AoS);
         template <class T>
         void add_resource(T &&t);
         template <class T>
         void add_resource(T &t);
         template <class T>
         bool has_component() const;
-        size_t get_eid();
+        template <class T>
+        void map_type();
+        EntityHandle create_handle();
         void add_entity(Entity &&entity);
+        void spawn(const std::vector<ecs::command::Command> &commands);
+        void erase_entity(size_t eid);
+
+        template <class T>
+        void attach(size_t eid, T &&t);
+        template <class T>
+        void detach(size_t eid);
+        ecs::archetype::EntityLocation &locate(size_t eid);
+        size_t archetype_edge(size_t idx, size_t cid, bool add);
+        size_t archetype_for(const bitset &m);
+
+        void notify_spawn(const Entity &e);
+        void notify_add(const Entity &e, size_t cid);
+        void notify_remove(size_t eid, size_t cid);
+        void notify_despawn(size_t eid);
 
         template <class T>
         T *get(Entity *e);
+        template <class T>
+        T *get(ecs::archetype::Archetype &archetype, size_t row, Entity *e);
+        template <class T>
+        ComponentPool<T> archetype_pool(ecs::archetype::Archetype &archetype);
+        template <class... Ts, class F, size_t... Is>
+        void sparse_batches(const std::vector<size_t> &matches, F &f, std::index_sequence<Is...>);
         size_t count_components() const;
 
         World(/* args */) //! World constructor is private. Use World::create().
         {
-            this->next_eid = 0;
+            this->generations = std::vector<uint32_t>();
+            this->free_eids = std::vector<uint32_t>();
             this->nodes = std::vector<RegistryNode>();
-            this->node_index_lookup = std::unordered_map<size_t, size_t>();
+            this->type_to_node = std::vector<size_t>();
             this->systems = ecs::dispatch::DispatcherContainer();
-            this->component_mask = ecs::entity::bitset(0);
+            this->component_mask = ecs::entity::bitset();
+            this->storage = StorageMode::SparseSet;
+            unsigned int hardware_threads = std::thread::hardware_concurrency();
+            this->n_threads = hardware_threads > 1 ? hardware_threads - 1 : 0;
+            this->dispatching = false;
             this->register_component<Entity>();
             WorldResource res(this);
             this->add_resource<WorldResource>(std::move(res));
@@ -267,11 +511,20 @@ namespace ecs::world
         World(const World &world) = delete;
         World(World &&world)
         {
-            this->next_eid = world.next_eid;
+            this->generations = std::move(world.generations);
+            this->free_eids = std::move(world.free_eids);
             this->nodes = std::move(world.nodes);
-            this->node_index_lookup = std::move(world.node_index_lookup);
+            this->type_to_node = std::move(world.type_to_node);
             this->systems = std::move(world.systems);
             this->component_mask = std::move(world.component_mask);
+            this->storage = world.storage;
+            this->archetypes = std::move(world.archetypes);
+            this->locations = std::move(world.locations);
+            this->queries = std::move(world.queries);
+            this->n_threads = world.n_threads;
+            this->workers = std::move(world.workers);
+            this->tracer_ptr = std::move(world.tracer_ptr);
+            this->dispatching = world.dispatching;
 
             auto world_res_node = this->find<WorldResource>();
             WorldResource res(this);
@@ -280,6 +533,10 @@ namespace ecs::world
 
         ecs::dispatch::DispatcherContainerBuilder add_systems();
         void dispatch();
+        ecs::thread_pool::ThreadPool *thread_pool();
+        void enable_tracing();
+        void disable_tracing();
+        ecs::trace::Tracer *tracer();
 
         template <class T>
         const RegistryNode *find() const;
@@ -287,13 +544,36 @@ namespace ecs::world
         RegistryNode *find();
         template <class T>
         size_t get_cid() const;
+        template <class T>
+        size_t count();
+        Entity *get_entity(EntityHandle handle);
+        template <class T>
+        ComponentRef<T> get_component(EntityHandle handle);
+        template <class... Ts, class F>
+        void for_each_chunk(F f);
+        template <class... Ts>
+        std::vector<EntityHandle> spawn_batch(size_t count, Ts *...components);
 
         template <class... Ts>
         bitset mask() const;
         template <class... Ts>
-        std::vector<std::tuple<Ts *...>> fetch();
+        class View;
         template <class... Ts>
-        std::vector<std::tuple<Ts *...>> safe_fetch();
+        View<Ts...> fetch();
+        template <class... Ts>
+        View<Ts...> safe_fetch();
+        template <class... Ts>
+        ecs::query::Query<Ts...> query();
+        template <class... Ts>
+        View<Ts...> fetch(ecs::query::Query<Ts...> &query);
+        template <class... Ts>
+        View<Ts...> fetch(ecs::query::Query<Ts...> &query, size_t first, size_t last);
+        template <class... Ts, class F>
+        void for_each_batch(ecs::query::Query<Ts...> &query, F f);
+        template <class... Ts>
+        size_t count(ecs::query::Query<Ts...> &query);
+        template <class... Ts, class F>
+        size_t despawn_where(F predicate);
 
         class WorldBuilder;
         friend class WorldBuilder;
@@ -306,18 +586,85 @@ namespace ecs::world
     };
 
     /**
-     * @brief Returns the eid for a new entity. 
+     * @brief Returns the EntityHandle for a new entity. 
+     * 
+     * The ids of removed Entities are reused before new ids are made, so the range of 
+     * ids stays as small as the most Entities alive at once. The generation of an id is
+     * increased when its Entity is removed, so the new handle differs from the old one.
+     * 
+     * @return EntityHandle 
+     * 
+     * @exception Throws a runtime exception if every 32 bit id is in use.
+     */
+    EntityHandle World::create_handle()
+    {
+        if (!this->free_eids.empty())
+        {
+            uint32_t index = this->free_eids.back();
+            this->free_eids.pop_back();
+            return {index, this->generations[index]};
+        }
+
+        if (this->generations.size() > UINT32_MAX)
+            throw std::runtime_error("Ran out of Entity ids");
+        this->generations.push_back(0);
+        return {static_cast<uint32_t>(this->generations.size() - 1), 0};
+    }
+
+    /**
+     * @brief Finds the Entity refered to by a handle in constant time.
      * 
-     * It is assumed that each Entity has a unique id, and that this function is used to 
-     * generate the eid for the Entity.
+     * @param handle - The EntityHandle.
+     * @return Entity* - The Entity, or nullptr if it has been removed from the World.
+     */
+    Entity *World::get_entity(EntityHandle handle)
+    {
+        if (handle.index >= this->generations.size() || this->generations[handle.index] != handle.generation)
+            return nullptr;
+
+        RegistryNode *node = this->find<Entity>();
+        size_t idx = node->index_of(handle.index);
+        if (idx == RegistryNode::npos)
+            return nullptr;
+        return node->get<Entity>(idx);
+    }
+
+    /**
+     * @brief Finds a component of the Entity refered to by a handle in constant time.
+     * 
+     * This is meant for following handles found outside of a fetch, e.g. from a
+     * spatial index. As with safe_fetch(), Entities and components which are staged
+     * for removal are still found until the commands are merged.
      * 
-     * TODO: Create a more sophisciated way to create and track eids.
+     * The component is returned as a ComponentRef, which works for components stored as
+     * SoA as well, and writes any changes back when it goes out of scope.
+     * 
+     * @tparam T - The component type to get.
+     * @param handle - The EntityHandle.
+     * @return ComponentRef<T> - The component, which is null if the Entity has been 
+     *                           removed from the World or doesn't have the component.
      * 
-     * @return size_t 
+     * @exception Throws a runtime exception if the component isn't registered to the world.
      */
-    size_t World::get_eid()
+    template <class T>
+    ComponentRef<T> World::get_component(EntityHandle handle)
     {
-        return this->next_eid++;
+        size_t cid = this->get_cid<T>();
+        Entity *e = this->get_entity(handle);
+        if (e == nullptr || !e->has_component(cid))
+            return ComponentRef<T>();
+
+        RegistryNode *node = this->find<T>();
+        if (node->is_resource())
+            return ComponentRef<T>(node->pool<T>(), 0);
+
+        if (this->storage == StorageMode::Archetype && !std::is_same_v<T, Entity>)
+        {
+            auto &loc = this->locate(e->eid());
+            return ComponentRef<T>(this->archetype_pool<T>(this->archetypes[loc.archetype]), loc.row);
+        }
+
+        return ComponentRef<T>(node->pool<T>(), node->index_of(e->eid()));
     }
 
     /**
@@ -333,7 +680,7 @@ namespace ecs::world
     {
         if (!this->has_component<T>())
             throw std::runtime_error("Component is not registered");
-        return this->node_index_lookup.at(typeid(T).hash_code());
+        return this->type_to_node[ecs::registry::type_id<T>()];
     }
 
     /**
@@ -352,7 +699,7 @@ namespace ecs::world
      * @tparam T - The component type to get.
      * @param e - A pointer to the Entity in question.
      * @return T* - A pointer to the Entity's component.
-     *
+     * 
      */
     template <class T>
     T *World::get(Entity *e)
@@ -361,156 +708,772 @@ namespace ecs::world
         if (node->is_resource())
             return node->get<T>(0);
 
-        size_t cid = this->get_cid<T>();
-        size_t idx = e->get_component(cid);
+        if (this->storage == StorageMode::Archetype && !std::is_same_v<T, Entity>)
+        {
+            auto &loc = this->locate(e->eid());
+            return this->get<T>(this->archetypes[loc.archetype], loc.row, e);
+        }
 
-        return node->get<T>(idx);
+        return node->get<T>(node->index_of(e->eid()));
     }
 
     /**
-     * @brief Creates a bitmask for a set of components
+     * @brief Getter function to a component in a row of an Archetype.
      * 
-     * @tparam Ts - The set of components
-     * @return bitset - The mask
+     * @tparam T - The component type to get.
+     * @param archetype - The Archetype.
+     * @param row - The row of the Entity in the Archetype.
+     * @param e - A pointer to the Entity stored in the row.
+     * @return T* - A pointer to the Entity's component.
      */
-    template <class... Ts>
-    bitset World::mask() const
+    template <class T>
+    T *World::get(ecs::archetype::Archetype &archetype, size_t row, Entity *e)
     {
-        bitset bits = bitset(this->count_components());
-        (bits.set(this->get_cid<Ts>()), ...);
-        return bits & this->component_mask;
+        if constexpr (std::is_same_v<T, Entity>)
+        {
+            return e;
+        }
+        else
+        {
+            RegistryNode *node = this->find<T>();
+            if (node->is_resource())
+                return node->get<T>(0);
+            return archetype.column(this->get_cid<T>())->template get<T>(row);
+        }
     }
 
     /**
-     * @brief Builds a vector of tuples of pointers to components for systems to iterate over.
+     * @brief Counts the Entities which have a component.
      * 
-     * Systems work on a set of components <A, B, ...>, and are intended to run over a
-     * tuple of component pointers <A*, B*, ...>, where each element in the tuple belongs
-     * to asingle Entity. This function aims to construct the tuples of system_data and
-     * group them into a vector which can then be iterated over.
-     * 
-     * If an entity which has components <A, B, ...> has been flagged for removal, then
-     * the components <A, B, ...> are staged for inavlidation. Once all of an Entity's
-     * components have been removed by fetch<Ts...> calls, then it can be staged for
-     * removal entirely.
-     * 
-     * @tparam Ts - The set of components to be fetched.
-     * @return std::vector<std::tuple<Ts *...>> 
+     * @tparam T - The component in question.
+     * @return size_t - The number of Entities with a T.
      */
-    template <class... Ts>
-    std::vector<std::tuple<Ts *...>> World::fetch()
+    template <class T>
+    size_t World::count()
     {
-        std::vector<std::tuple<Ts *...>> vec;
-        bitset m = this->mask<Ts...>();
-        auto node = this->find<Entity>();
-        for (auto &e : *(node->iter<Entity>()))
+        RegistryNode *node = this->find<T>();
+        if (node->is_resource())
+            return 1;
+
+        if (this->storage == StorageMode::SparseSet || std::is_same_v<T, Entity>)
+            return node->size<T>();
+
+        size_t n = 0;
+        bitset m = this->mask<T>();
+        for (auto &archetype : this->archetypes)
         {
-            if (e.has_component(m))
-            {
-                if (e.is_flagged_for_removal())
-                {
-                    auto world_res = this->find<WorldResource>()->get<WorldResource>(0);
-                    if (e.is_alive())
-                    {
-                        world_res->invalidate_entity_components<Ts...>(&e);
-                    }
-                    else
-                    {
-                        world_res->stage_entity_for_removal(&e);
-                    }
-                }
-                else
-                {
-                    auto tuple = std::make_tuple(this->get<Ts>(&e)...);
-                    vec.push_back(tuple);
-                }
-            }
+            if (archetype.matches(m))
+                n += archetype.size();
         }
-        return std::move(vec);
+        return n;
     }
 
     /**
-     * @brief Builds a vector of tuples of pointers to components for systems to iterate over.
+     * @brief Stores a component for an Entity.
      * 
-     * Systems work on a set of components <A, B, ...>, and are intended to run over a
-     * tuple of component pointers <A*, B*, ...>, where each element in the tuple belongs
-     * to asingle Entity. This function aims to construct the tuples of system_data and
-     * group them into a vector which can then be iterated over.
+     * This only alters the component storage, the Entity's bitset has to be updated by
+     * the caller. The Entity does not have to be added to the World yet.
      * 
-     * If an entity which has components <A, B, ...> has been flagged for removal, then
-     * the components <A, B, ...> are staged for inavlidation. Once all of an Entity's
-     * components have been removed by fetch<Ts...> calls, then it can be staged for
-     * removal entirely.
+     * When using Archetype storage, the Entity's components are moved to the Archetype
+     * which also has a T.
      * 
-     * @tparam Ts - The set of components to be fetched.
-     * @return std::vector<std::tuple<Ts *...>> 
+     * @tparam T - The component type.
+     * @param eid - The Entity id.
+     * @param t - The component. This is consumed.
+     * 
+     * @exception Throws a runtime exception if the Entity already has a T.
      */
-    template <class... Ts>
-    std::vector<std::tuple<Ts *...>> World::safe_fetch()
+    template <class T>
+    void World::attach(size_t eid, T &&t)
     {
-        std::vector<std::tuple<Ts *...>> vec;
-        bitset m = this->mask<Ts...>();
-        auto node = this->find<Entity>();
-        for (auto &e : *(node->iter<Entity>()))
+        RegistryNode *node = this->find<T>();
+        if (this->storage == StorageMode::SparseSet)
         {
-            if (e.has_valid_component(m))
-            {
-                auto tuple = std::make_tuple(this->get<Ts>(&e)...);
-                vec.push_back(tuple);
-            }
+            node->push<T>(eid, std::move(t));
+            return;
         }
-        return std::move(vec);
+
+        size_t cid = this->get_cid<T>();
+        auto &loc = this->locate(eid);
+        if (this->archetypes[loc.archetype].column(cid) != nullptr)
+            throw std::runtime_error("Entity already has this component");
+        size_t dst_idx = this->archetype_edge(loc.archetype, cid, true);
+
+        auto &src = this->archetypes[loc.archetype];
+        auto &dst = this->archetypes[dst_idx];
+        size_t moved = src.move_row(loc.row, dst);
+        if (moved != RegistryNode::npos)
+            this->locations[moved].row = loc.row;
+
+        dst.column(cid)->append<T>(std::move(t));
+        loc = {dst_idx, dst.size() - 1};
     }
 
     /**
-     * @brief Adds a built Entity to the World.
+     * @brief Destroys the stored component of an Entity.
      * 
-     * This consumes the Entity
+     * This only alters the component storage, the Entity's bitset has to be updated by
+     * the caller.
      * 
-     * @param entity - The built Entity.
+     * When using Archetype storage, the Entity's components are moved to the Archetype
+     * without a T.
+     * 
+     * @tparam T - The component type.
+     * @param eid - The Entity id.
      */
-    void World::add_entity(Entity &&entity)
+    template <class T>
+    void World::detach(size_t eid)
     {
-        auto node = this->find<Entity>();
-        node->push<Entity>(std::move(entity));
+        RegistryNode *node = this->find<T>();
+        if (this->storage == StorageMode::SparseSet)
+        {
+            node->erase<T>(eid);
+            return;
+        }
+
+        size_t cid = this->get_cid<T>();
+        auto &loc = this->locate(eid);
+        if (this->archetypes[loc.archetype].column(cid) == nullptr)
+            return;
+        size_t dst_idx = this->archetype_edge(loc.archetype, cid, false);
+
+        auto &src = this->archetypes[loc.archetype];
+        auto &dst = this->archetypes[dst_idx];
+        size_t moved = src.move_row(loc.row, dst);
+        if (moved != RegistryNode::npos)
+            this->locations[moved].row = loc.row;
+
+        loc = {dst_idx, dst.size() - 1};
     }
 
     /**
-     * @brief Adds a system to the dispathcer
+     * @brief Getter function for the location of an Entity's components in Archetype storage.
      * 
-     * @param exe_ptr 
+     * An Entity which isn't stored yet is placed in the Archetype without components.
+     * 
+     * @param eid - The Entity id.
+     * @return ecs::archetype::EntityLocation& 
      */
-    ecs::dispatch::DispatcherContainerBuilder World::add_systems()
+    ecs::archetype::EntityLocation &World::locate(size_t eid)
     {
-        ecs::dispatch::DispatcherContainerBuilder builder(&this->systems);
-        return builder;
+        if (eid >= this->locations.size())
+            this->locations.resize(eid + 1, {RegistryNode::npos, RegistryNode::npos});
+
+        auto &loc = this->locations[eid];
+        if (loc.archetype == RegistryNode::npos)
+            loc = {0, this->archetypes[0].push_entity(eid)};
+        return loc;
     }
 
     /**
-     * @brief Checks if a component is registered.
+     * @brief Finds the Archetype reached by adding or removing a component from an Archetype.
      * 
-     * @tparam T - The component in question.
-     * @return true - The component is registered.
-     * @return false - The component is not registered.
+     * If the Archetype doesn't exist yet, it is created with a Column for each component
+     * in its mask. The component must not already be in the Archetype when it is added,
+     * or missing from it when it is removed.
+     * 
+     * @param idx - The index of the Archetype to start from.
+     * @param cid - The component to add or remove.
+     * @param add - true if the component is added, false if it is removed.
+     * @return size_t - The index of the Archetype reached.
+     */
+    size_t World::archetype_edge(size_t idx, size_t cid, bool add)
+    {
+        assert(this->archetypes[idx].mask()[cid] != add);
+        size_t edge = add ? this->archetypes[idx].add_edge(cid) : this->archetypes[idx].remove_edge(cid);
+        if (edge != RegistryNode::npos)
+            return edge;
+
+        bitset m = this->archetypes[idx].mask();
+        m[cid] = add;
+        for (size_t i = 0; i < this->archetypes.size(); i++)
+        {
+            if (this->archetypes[i].mask() == m)
+                edge = i;
+        }
+
+        if (edge == RegistryNode::npos)
+        {
+            ecs::archetype::Archetype archetype(m);
+            size_t entity_cid = this->get_cid<Entity>();
+            for (size_t c = 0; c < m.size(); c++)
+            {
+                if (m[c] && c != entity_cid)
+                    archetype.add_column(c, this->nodes[c].make_column());
+            }
+            edge = this->archetypes.size();
+            this->archetypes.push_back(std::move(archetype));
+
+            for (auto &state : this->queries)
+            {
+                if (state->matches(m))
+                    state->add_archetype(edge);
+            }
+        }
+
+        if (add)
+        {
+            this->archetypes[idx].set_add_edge(cid, edge);
+            this->archetypes[edge].set_remove_edge(cid, idx);
+        }
+        else
+        {
+            this->archetypes[idx].set_remove_edge(cid, edge);
+            this->archetypes[edge].set_add_edge(cid, idx);
+        }
+        return edge;
+    }
+
+    /**
+     * @brief Finds the Archetype with a set of components, following the edges from the
+     * Archetype without components.
+     * 
+     * @param m - The components. The Entity component is ignored.
+     * @return size_t - The index of the Archetype.
+     */
+    size_t World::archetype_for(const bitset &m)
+    {
+        size_t entity_cid = this->get_cid<Entity>();
+        size_t idx = 0;
+        for (size_t cid = 0; cid < m.size(); cid++)
+        {
+            if (m[cid] && cid != entity_cid)
+                idx = this->archetype_edge(idx, cid, true);
+        }
+        return idx;
+    }
+
+    /**
+     * @brief Creates a bitmask for a set of components
+     * 
+     * @tparam Ts - The set of components
+     * @return bitset - The mask
+     */
+    template <class... Ts>
+    bitset World::mask() const
+    {
+        bitset bits;
+        (bits.set(this->get_cid<Ts>()), ...);
+        return bits & this->component_mask;
+    }
+
+    /**
+     * @brief Makes a Query for a set of components.
+     * 
+     * The World keeps the matches of the Query up to date as Entities and components
+     * are added and removed, so fetching the Query doesn't have to search every Entity.
+     * Queries for the same components share their state.
+     * 
+     * Note: This function *NOT* System-Safe.
+     * 
+     * @tparam Ts - The set of components.
+     * @return ecs::query::Query<Ts...> 
+     */
+    template <class... Ts>
+    ecs::query::Query<Ts...> World::query()
+    {
+        bitset m = this->mask<Ts...>();
+        for (auto &state : this->queries)
+        {
+            if (state->mask() == m)
+                return ecs::query::Query<Ts...>(state.get());
+        }
+
+        auto state = std::make_unique<ecs::query::QueryState>(m);
+        if (this->storage == StorageMode::Archetype)
+        {
+            for (size_t i = 0; i < this->archetypes.size(); i++)
+            {
+                if (state->matches(this->archetypes[i].mask()))
+                    state->add_archetype(i);
+            }
+        }
+        else
+        {
+            auto node = this->find<Entity>();
+            for (auto &e : *(node->iter<Entity>()))
+            {
+                if (e.has_component(m))
+                    state->insert(e.eid());
+            }
+        }
+
+        this->queries.push_back(std::move(state));
+        return ecs::query::Query<Ts...>(this->queries.back().get());
+    }
+
+    /**
+     * @brief Getter function for the ComponentPool of a component in an Archetype.
+     * 
+     * The Entity component and resources aren't stored in the Archetype, so the pool of
+     * their RegistryNode is used instead.
+     * 
+     * @tparam T - The component type.
+     * @param archetype - An Archetype with a T.
+     * @return ComponentPool<T> 
+     */
+    template <class T>
+    ComponentPool<T> World::archetype_pool(ecs::archetype::Archetype &archetype)
+    {
+        RegistryNode *node = this->find<T>();
+        if (node->is_resource() || std::is_same_v<T, Entity>)
+            return node->pool<T>();
+        return archetype.column(this->get_cid<T>())->template pool<T>();
+    }
+
+    /**
+     * @brief Adds a built Entity to the World.
+     * 
+     * This consumes the Entity
+     * 
+     * @param entity - The built Entity.
+     */
+    void World::add_entity(Entity &&entity)
+    {
+        auto node = this->find<Entity>();
+        size_t eid = entity.eid();
+        if (this->storage == StorageMode::Archetype)
+            this->locate(eid);
+        node->push<Entity>(eid, std::move(entity));
+        this->notify_spawn(*node->get<Entity>(node->index_of(eid)));
+    }
+
+    /**
+     * @brief Adds the Entities staged by EntityBuilders to the World.
+     * 
+     * The storage of each component type is grown once for the whole batch, and the
+     * components are then appended grouped by type. With Archetype storage each Entity is
+     * placed straight into the Archetype of its final set of components, rather than
+     * moving through an Archetype for every component it's built with.
+     * 
+     * Note: This function *NOT* System-Safe.
+     * 
+     * @param commands - Spawn phase Commands, see ecs::command::Phase. Their components
+     *                   are consumed, even if this throws.
+     */
+    void World::spawn(const std::vector<ecs::command::Command> &commands)
+    {
+        if (commands.empty())
+            return;
+
+        // A component which hasn't been moved in is destroyed if anything throws, since
+        // the Commands can't be applied again.
+        std::vector<ecs::command::Command> grouped;
+        size_t applied = 0;
+        bool moving = false;
+        try
+        {
+            // Give every new Entity an id, and count the components of each type.
+            size_t entity_cid = this->get_cid<Entity>();
+            std::vector<Entity> spawned;
+            std::vector<size_t> offsets(this->nodes.size() + 1, 0);
+            for (size_t i = 0; i < commands.size(); i += commands[i].eid + 1)
+            {
+                Entity entity(this->create_handle());
+                entity.add_component(entity_cid);
+                for (size_t j = i + 1; j <= i + commands[i].eid; j++)
+                {
+                    entity.add_component(commands[j].cid);
+                    offsets[commands[j].cid + 1]++;
+                }
+                spawned.push_back(std::move(entity));
+            }
+
+            if (this->storage == StorageMode::SparseSet)
+            {
+                for (size_t cid = 0; cid < this->nodes.size(); cid++)
+                {
+                    if (offsets[cid + 1] > 0)
+                        this->nodes[cid].reserve(offsets[cid + 1]);
+                }
+            }
+            else
+            {
+                // Find the Archetype of each Entity. Entities built together usually have the
+                // same components, so the last Archetype found is tried first.
+                std::vector<size_t> placement(spawned.size());
+                bitset last_mask;
+                size_t last_idx = RegistryNode::npos;
+                for (size_t k = 0; k < spawned.size(); k++)
+                {
+                    const bitset &m = spawned[k].mask();
+                    if (last_idx == RegistryNode::npos || m != last_mask)
+                    {
+                        last_idx = this->archetype_for(m);
+                        last_mask = m;
+                    }
+                    placement[k] = last_idx;
+                }
+
+                std::vector<size_t> rows(this->archetypes.size(), 0);
+                for (size_t idx : placement)
+                    rows[idx]++;
+                for (size_t idx = 0; idx < rows.size(); idx++)
+                {
+                    if (rows[idx] > 0)
+                        this->archetypes[idx].reserve(rows[idx]);
+                }
+
+                for (size_t k = 0; k < spawned.size(); k++)
+                {
+                    size_t eid = spawned[k].eid();
+                    if (eid >= this->locations.size())
+                        this->locations.resize(eid + 1, {RegistryNode::npos, RegistryNode::npos});
+                    this->locations[eid] = {placement[k], this->archetypes[placement[k]].push_row(eid)};
+                }
+            }
+
+            // Group the component Commands by type, keeping their order within each type so
+            // that the rows of each Archetype line up, then append every component.
+            for (size_t cid = 0; cid < this->nodes.size(); cid++)
+                offsets[cid + 1] += offsets[cid];
+            grouped.resize(offsets.back());
+            for (size_t i = 0, k = 0; i < commands.size(); i += commands[i].eid + 1, k++)
+            {
+                for (size_t j = i + 1; j <= i + commands[i].eid; j++)
+                {
+                    ecs::command::Command &command = grouped[offsets[commands[j].cid]++];
+                    command = commands[j];
+                    command.eid = spawned[k].eid();
+                }
+            }
+            moving = true;
+            for (; applied < grouped.size(); applied++)
+                grouped[applied].apply(this, grouped[applied]);
+
+            this->find<Entity>()->reserve(spawned.size());
+            for (auto &entity : spawned)
+                this->add_entity(std::move(entity));
+        }
+        catch (...)
+        {
+            if (!moving)
+            {
+                for (auto &command : commands)
+                {
+                    if (command.destroy)
+                        command.destroy(command.payload);
+                }
+            }
+            else
+            {
+                // The component which threw was destroyed when it was applied.
+                for (size_t j = applied + 1; j < grouped.size(); j++)
+                    grouped[j].destroy(grouped[j].payload);
+            }
+            throw;
+        }
+    }
+
+    /**
+     * @brief Adds count Entities with the components Ts, moved from arrays.
+     * 
+     * This is the fast way to fill a World with many Entities. Every RegistryNode (or
+     * Archetype Column) is grown once, and the components of each type are moved in as
+     * one range. The Entities are given the ids freed by removed Entities first, with the
+     * current generation of each id, in the same way as World::create_handle(). Only the
+     * rest are given new ids, so spawning and removing Entities over and over doesn't 
+     * grow the id space.
+     * 
+     * Note: This function *NOT* System-Safe. Use an EntityBuilder from within a System.
+     * 
+     * @tparam Ts - The components of the Entities.
+     * @param count - The number of Entities.
+     * @param components - An array of count components for each of Ts. These are consumed.
+     * @return std::vector<EntityHandle> - The handles of the Entities. The ith Entity owns
+     *                                     the ith element of each array.
+     * 
+     * @exception Throws a runtime exception if called during World::dispatch(), if Ts
+     *            aren't distinct registered components, or if the World runs out of 
+     *            Entity ids.
+     */
+    template <class... Ts>
+    std::vector<EntityHandle> World::spawn_batch(size_t count, Ts *...components)
+    {
+        if (this->dispatching)
+            throw std::runtime_error("spawn_batch cannot be used while Systems are running");
+
+        size_t entity_cid = this->get_cid<Entity>();
+        bitset m = this->mask<Ts...>();
+        if (m.count() != sizeof...(Ts) || m[entity_cid])
+            throw std::runtime_error("spawn_batch needs distinct components, other than Entity");
+        m.set(entity_cid);
+
+        // Free ids are reused first, and only the rest are new.
+        size_t recycled = std::min(count, this->free_eids.size());
+        size_t first = this->generations.size();
+        if (count - recycled > static_cast<size_t>(UINT32_MAX) + 1 - first)
+            throw std::runtime_error("Ran out of Entity ids");
+
+        std::vector<EntityHandle> handles;
+        std::vector<size_t> eids;
+        handles.reserve(count);
+        eids.reserve(count);
+        for (size_t i = 0; i < recycled; i++)
+        {
+            uint32_t index = this->free_eids.back();
+            this->free_eids.pop_back();
+            handles.push_back({index, this->generations[index]});
+            eids.push_back(index);
+        }
+        this->generations.resize(first + count - recycled, 0);
+        for (size_t eid = first; eid < this->generations.size(); eid++)
+        {
+            handles.push_back({static_cast<uint32_t>(eid), 0});
+            eids.push_back(eid);
+        }
+
+        if (this->storage == StorageMode::SparseSet)
+        {
+            (this->nodes[this->get_cid<Ts>()].template push_range<Ts>(eids.data(), count, components), ...);
+        }
+        else
+        {
+            size_t idx = this->archetype_for(m);
+            auto &archetype = this->archetypes[idx];
+            archetype.reserve(count);
+            if (this->generations.size() > this->locations.size())
+                this->locations.resize(this->generations.size(), {RegistryNode::npos, RegistryNode::npos});
+            for (size_t eid : eids)
+                this->locations[eid] = {idx, archetype.push_row(eid)};
+            (archetype.column(this->get_cid<Ts>())->template append_range<Ts>(count, components), ...);
+        }
+
+        size_t cids[] = {entity_cid, this->get_cid<Ts>()...};
+        std::vector<Entity> entities;
+        entities.reserve(count);
+        for (EntityHandle handle : handles)
+        {
+            Entity entity(handle);
+            for (size_t cid : cids)
+                entity.add_component(cid);
+            entities.push_back(std::move(entity));
+        }
+        this->find<Entity>()->push_range<Entity>(eids.data(), count, entities.data());
+
+        // Each matching Query is updated once for the whole range.
+        if (this->storage == StorageMode::SparseSet)
+        {
+            for (auto &state : this->queries)
+            {
+                if (state->matches(m))
+                {
+                    for (size_t eid : eids)
+                        state->insert(eid);
+                }
+            }
+        }
+        return handles;
+    }
+
+    /**
+     * @brief Removes an Entity, and all of its components, from the World.
+     * 
+     * The Entity's id is then free to be reused by a new Entity, and handles to the
+     * removed Entity are no longer valid.
+     * 
+     * Note: This function *NOT* System-Safe.
+     * 
+     * @param eid - The Entity id.
+     */
+    void World::erase_entity(size_t eid)
+    {
+        RegistryNode *entity_node = this->find<Entity>();
+        if (!entity_node->contains(eid))
+            return;
+
+        if (this->storage == StorageMode::Archetype && eid < this->locations.size())
+        {
+            auto loc = this->locations[eid];
+            if (loc.archetype != RegistryNode::npos)
+            {
+                size_t moved = this->archetypes[loc.archetype].remove_row(loc.row);
+                if (moved != RegistryNode::npos)
+                    this->locations[moved].row = loc.row;
+                this->locations[eid] = {RegistryNode::npos, RegistryNode::npos};
+            }
+        }
+        else if (this->storage == StorageMode::SparseSet)
+        {
+            // An Entity doesn't know the types of its components, so each one is erased
+            // through the type erased operations of its RegistryNode.
+            Entity *e = entity_node->get<Entity>(entity_node->index_of(eid));
+            size_t entity_cid = this->get_cid<Entity>();
+            for (size_t cid = 0; cid < this->nodes.size(); cid++)
+            {
+                if (cid != entity_cid && e->has_component(cid))
+                    this->nodes[cid].remove(eid);
+            }
+        }
+        this->notify_despawn(eid);
+        entity_node->erase<Entity>(eid);
+
+        this->generations[eid]++;
+        this->free_eids.push_back(static_cast<uint32_t>(eid));
+    }
+
+    /**
+     * @brief Updates the Queries after an Entity has been added to the World.
+     * 
+     * @param e - The Entity.
+     */
+    void World::notify_spawn(const Entity &e)
+    {
+        if (this->storage == StorageMode::Archetype)
+            return;
+        for (auto &state : this->queries)
+        {
+            if (e.has_component(state->mask()))
+                state->insert(e.eid());
+        }
+    }
+
+    /**
+     * @brief Updates the Queries after a component has been added to an Entity.
+     * 
+     * @param e - The Entity.
+     * @param cid - The component id.
+     */
+    void World::notify_add(const Entity &e, size_t cid)
+    {
+        if (this->storage == StorageMode::Archetype)
+            return;
+        for (auto &state : this->queries)
+        {
+            if (state->is_affected_by(cid) && e.has_component(state->mask()))
+                state->insert(e.eid());
+        }
+    }
+
+    /**
+     * @brief Updates the Queries after a component has been removed from an Entity.
+     * 
+     * @param eid - The Entity id.
+     * @param cid - The component id.
+     */
+    void World::notify_remove(size_t eid, size_t cid)
+    {
+        if (this->storage == StorageMode::Archetype)
+            return;
+        for (auto &state : this->queries)
+        {
+            if (state->is_affected_by(cid))
+                state->erase(eid);
+        }
+    }
+
+    /**
+     * @brief Updates the Queries after an Entity has been removed from the World.
+     * 
+     * @param eid - The Entity id.
+     */
+    void World::notify_despawn(size_t eid)
+    {
+        for (auto &state : this->queries)
+            state->erase(eid);
+    }
+
+    /**
+     * @brief Adds a system to the dispathcer
+     * 
+     * @param exe_ptr 
+     */
+    ecs::dispatch::DispatcherContainerBuilder World::add_systems()
+    {
+        ecs::dispatch::DispatcherContainerBuilder builder(&this->systems, this);
+        return builder;
+    }
+
+    /**
+     * @brief Getter function for the ThreadPool which runs the Systems of this World.
+     * 
+     * @return ecs::thread_pool::ThreadPool* 
+     */
+    ecs::thread_pool::ThreadPool *World::thread_pool()
+    {
+        return this->workers.get();
+    }
+
+    /**
+     * @brief Starts recording how long each System and merge takes during dispatches.
+     * 
+     * Nothing is done if tracing is already enabled. The events are kept until tracing
+     * is disabled, and can be written out with Tracer::write_chrome_trace().
+     * 
+     * @exception Throws a runtime exception if called during World::dispatch().
+     */
+    void World::enable_tracing()
+    {
+        if (this->dispatching)
+            throw std::runtime_error("Tracing can't be enabled during a dispatch");
+        if (!this->tracer_ptr)
+            this->tracer_ptr = std::make_unique<ecs::trace::Tracer>(this->workers ? this->workers->size() + 1 : 1);
+    }
+
+    /**
+     * @brief Stops recording dispatches, and drops every recorded event.
+     * 
+     * @exception Throws a runtime exception if called during World::dispatch().
+     */
+    void World::disable_tracing()
+    {
+        if (this->dispatching)
+            throw std::runtime_error("Tracing can't be disabled during a dispatch");
+        this->tracer_ptr.reset();
+    }
+
+    /**
+     * @brief Getter function for the Tracer recording the dispatches of this World.
+     * 
+     * @return ecs::trace::Tracer* - nullptr if tracing isn't enabled.
+     */
+    ecs::trace::Tracer *World::tracer()
+    {
+        return this->tracer_ptr.get();
+    }
+
+    /**
+     * @brief Checks if a component is registered.
+     * 
+     * @tparam T - The component in question.
+     * @return true - The component is registered.
+     * @return false - The component is not registered.
      */
     template <class T>
     bool World::has_component() const
     {
-        return this->node_index_lookup.find(typeid(T).hash_code()) != this->node_index_lookup.end();
+        size_t tid = ecs::registry::type_id<T>();
+        return tid < this->type_to_node.size() && this->type_to_node[tid] != RegistryNode::npos;
+    }
+
+    /**
+     * @brief Maps the type id of T to the next RegistryNode to be added.
+     * 
+     * @tparam T - The type being registered.
+     */
+    template <class T>
+    void World::map_type()
+    {
+        size_t tid = ecs::registry::type_id<T>();
+        if (tid >= this->type_to_node.size())
+            this->type_to_node.resize(tid + 1, RegistryNode::npos);
+        this->type_to_node[tid] = this->nodes.size();
     }
 
     /**
      * @brief Registers a component to the World.
      * 
      * @tparam T - The type to be registered.
+     * @param layout - How the components are laid out in memory.
      */
     template <class T>
-    void World::register_component()
+    void World::register_component(Layout layout)
     {
         if (this->has_component<T>())
             throw std::runtime_error("Component is already registered");
-        this->node_index_lookup.emplace(typeid(T).hash_code(), this->nodes.size());
-        this->nodes.push_back(RegistryNode::create<T>());
+        RegistryNode node = RegistryNode::create<T>(layout);
+        this->map_type<T>();
+        this->nodes.push_back(std::move(node));
     }
 
     /**
@@ -523,7 +1486,7 @@ namespace ecs::world
     {
         if (this->has_component<T>())
             throw std::runtime_error("Already have a resource of this type!");
-        this->node_index_lookup.emplace(typeid(T).hash_code(), this->nodes.size());
+        this->map_type<T>();
         this->nodes.push_back(RegistryNode::create_resource<T>(std::move(t)));
     }
 
@@ -537,7 +1500,7 @@ namespace ecs::world
     {
         if (this->has_component<T>())
             throw std::runtime_error("Already have a resource of this type!");
-        this->node_index_lookup.emplace(typeid(T).hash_code(), this->nodes.size());
+        this->map_type<T>();
         this->nodes.push_back(RegistryNode::create_resource<T>(t));
     }
 
@@ -552,8 +1515,7 @@ namespace ecs::world
     {
         if (!this->has_component<T>())
             throw std::runtime_error("Component is not registered");
-        size_t idx = this->node_index_lookup.at(typeid(T).hash_code());
-        return &this->nodes.at(idx);
+        return &this->nodes[this->type_to_node[ecs::registry::type_id<T>()]];
     }
 
     /**
@@ -567,8 +1529,7 @@ namespace ecs::world
     {
         if (!this->has_component<T>())
             throw std::runtime_error("Component is not registered");
-        size_t idx = this->node_index_lookup.at(typeid(T).hash_code());
-        return &this->nodes.at(idx);
+        return &this->nodes[this->type_to_node[ecs::registry::type_id<T>()]];
     }
 
     /**
@@ -579,23 +1540,107 @@ namespace ecs::world
     WorldResource::WorldResource(World *world_pointer)
     {
         this->world_ptr = world_pointer;
+        this->buffers.push_back(std::make_unique<ecs::command::CommandBuffer>());
     }
 
     WorldResource::WorldResource(WorldResource &&other)
     {
         this->world_ptr = other.world_ptr;
+        this->buffers = std::move(other.buffers);
     }
 
     WorldResource &WorldResource::operator=(WorldResource &&other)
     {
         this->world_ptr = other.world_ptr;
+        this->buffers = std::move(other.buffers);
         return *this;
     }
 
+    /**
+     * @brief Makes sure there is a CommandBuffer for every thread which can run Systems.
+     * 
+     * This must not be called while Systems are running.
+     * 
+     * @param n_threads - The number of threads, including the thread calling dispatch.
+     */
+    void WorldResource::reserve_buffers(size_t n_threads)
+    {
+        while (this->buffers.size() < n_threads)
+            this->buffers.push_back(std::make_unique<ecs::command::CommandBuffer>());
+    }
+
+    /**
+     * @brief Getter function for the CommandBuffer of the calling thread.
+     * 
+     * @return ecs::command::CommandBuffer& 
+     */
+    ecs::command::CommandBuffer &WorldResource::local_buffer()
+    {
+        ecs::thread_pool::ThreadPool *pool = this->world_ptr->thread_pool();
+        size_t index = pool != nullptr ? pool->thread_index() : 0;
+        return *this->buffers.at(index);
+    }
+
+    /**
+     * @brief Applies a Command which adds a component to an Entity.
+     * 
+     * The component is moved out of the CommandBuffer's arena and destroyed there. If
+     * the Entity can't be given the component, it is destroyed without being added.
+     * 
+     * @tparam T - The type of the component.
+     * @param w - The World.
+     * @param command - The Command.
+     */
+    template <class T>
+    void WorldResource::apply_add(World *w, const ecs::command::Command &command)
+    {
+        T *t = static_cast<T *>(command.payload);
+        Entity *e = w->find<Entity>()->pool<Entity>().find(command.eid);
+        try
+        {
+            w->attach<T>(command.eid, std::move(*t));
+        }
+        catch (...)
+        {
+            t->~T();
+            throw;
+        }
+        e->add_component(command.cid);
+        w->notify_add(*e, command.cid);
+        t->~T();
+    }
+
+    /**
+     * @brief Applies a Command which removes a component from an Entity.
+     * 
+     * @tparam T - The type of the component.
+     * @param w - The World.
+     * @param command - The Command.
+     */
+    template <class T>
+    void WorldResource::apply_remove(World *w, const ecs::command::Command &command)
+    {
+        Entity *e = w->find<Entity>()->pool<Entity>().find(command.eid);
+        e->remove_component(command.cid);            // Forget the component
+        w->detach<T>(command.eid);                    // Delete the component
+        w->notify_remove(command.eid, command.cid);   // Update the Queries
+    }
+
+    /**
+     * @brief Applies a Command which removes an Entity from the World.
+     * 
+     * @param w - The World.
+     * @param command - The Command.
+     */
+    void WorldResource::apply_despawn(World *w, const ecs::command::Command &command)
+    {
+        w->erase_entity(command.eid); // Delete the Entity and its components
+    }
+
     /**
      * @brief Adds a component to an entity.
      * 
-     * In order to be thread safe, this is also done during the merge of each stage.
+     * In order to be thread safe, this is also done when the Commands are merged.
      * 
      * @tparam T 
      * @param e 
@@ -604,14 +1649,10 @@ namespace ecs::world
     template <class T>
     void WorldResource::add_component_to_entity(Entity *e, T &&t)
     {
-
-        RegistryNode *node = world_ptr->find<T>();
-        size_t cid = world_ptr->get_cid<T>();
-        auto f = [e, node, cid, &t]() {
-            e->add_component(cid, node->size<T>());
-            node->push<T>(std::move(t));
-        };
-        this->add_functions.push_back(f);
+        size_t cid = this->world_ptr->get_cid<T>();
+        ecs::command::CommandBuffer &buffer = this->local_buffer();
+        T *payload = buffer.emplace<T>(std::move(t));
+        buffer.push(ecs::command::Phase::Add, {e->eid(), cid, payload, &WorldResource::apply_add<T>, &ecs::command::destroy<T>});
     }
 
     /**
@@ -644,302 +1685,323 @@ namespace ecs::world
         if (!e->has_component(cid))
             throw std::runtime_error("Cannot remove a component from an entity if it doesn't have it.");
 
-        // Get the index of the component to be removed.
-        size_t entity_component_index = e->get_component(cid);
-
-        // Fetch the RegistryNode for the component
-        RegistryNode *node_ptr = this->world_ptr->find<T>();
-
-        // Create a lambda function to delete the component instance, and remove the
-        // entity's knowledge of the component.
-        auto f = [node_ptr, entity_component_index, e, cid]() {
-            e->remove_component(cid);                   // Forget the component
-            node_ptr->erase<T>(entity_component_index); // Delete the component
-        };
-
-        // Add the lambda function to be called later paired with the component index.
-        this->remove_functions.push_back(std::make_tuple(cid, entity_component_index, std::move(f)));
-    }
-
-    /**
-     * @brief Mark an Entity's component as invalid.
-     * 
-     * This is a helper function used for removing Entities gradually. Unlike with a 
-     * component removal, the Entity can still be fetched for component T, but it will 
-     * not be operated on. This will allow for Components to be destructed over system
-     * execution, until all of an Entity's components have been removed.
-     * 
-     * @tparam T 
-     * @param e 
-     */
-    template <class T>
-    void WorldResource::invalidate_entity_component(Entity *e)
-    {
-
-        // Get the component id of T.
-        size_t cid = this->world_ptr->get_cid<T>();
-
-        size_t ENTITY_CID = this->world_ptr->get_cid<Entity>();
-        // If trying to remove the Entity Component don't do anything.
-        if (cid == ENTITY_CID)
-        {
-            return;
-        }
-
-        // If the Entity no longer has a valid T component, return and don't do anything.
-        // Otherwise, set the component to invalid.
-        if (!e->has_valid_component(cid))
-            return;
-
-        // Get the index of the component to be removed.
-        size_t entity_component_index = e->get_component(cid);
-
-        // Fetch the RegistryNode for the component
-        RegistryNode *node_ptr = this->world_ptr->find<T>();
-
-        // Create a lambda function to delete the component instance, and remove the
-        // entity's knowledge of the component.
-        auto f = [node_ptr, entity_component_index, e, cid]() {
-            e->invalidate_component(cid);               // Invalidate the component
-            node_ptr->erase<T>(entity_component_index); // Delete the component
-        };
-
-        // Add the lambda function to be called later paired with the component index.
-        this->remove_functions.push_back(std::make_tuple(cid, entity_component_index, std::move(f)));
-    }
-
-    /**
-     * @brief Invalidates a set of components for an Entity.
-     * 
-     * This is used during a fetch<Ts... > call and allows for Systems to destruct 
-     * components of Entitys which have been marked for removal.
-     * 
-     * @tparam Ts 
-     * @param e 
-     */
-    template <class... Ts>
-    void WorldResource::invalidate_entity_components(Entity *e)
-    {
-        (this->invalidate_entity_component<Ts>(e), ...);
+        // Add the Command to be applied later.
+        this->local_buffer().push(ecs::command::Phase::Remove, {e->eid(), cid, nullptr, &WorldResource::apply_remove<T>, nullptr});
     }
 
     /**
-     * @brief Flags an entity for removal.
-     * 
-     * Because an Entity is not aware of the types of it's components, an Entity cannot
-     * be destroyed instantly, but rather it must be destroyed over time by different
-     * systems execution. 
+     * @brief Stages an Entity for removal.
      * 
-     * As systems are exeucted, a fetch<Ts ...> call is made, and if the Entity would 
-     * meet the requirements to be executed, the components will be invalidated and 
-     * destroyed instead of being executed. Once the Entity is only comprised of the 
-     * Entity component and nothing else, it can then be staged for removal. 
-     * 
-     * Note: 
-     *      It is possible that an Entity may never be destroyed until the end of 
-     *      program execution. Should the programmer choose to make systems which remove 
-     *      the components of an Entity in such a way that there are components which are
-     *      never used in systems, then the Entity will be forever flagged for removal, 
-     *      but never staged. 
-     *      
-     *      This is an unlikely situation, and could be resolved with additional work, 
-     *      but is beyond the scope of this project. The overall cost of this situation
-     *      is a little bit of overhead, but doesn't cause any memory leaks or undefined
-     *      behaviour.
+     * The Entity, and all of its components, are removed when the Commands are merged.
+     * Until then, the Entity is still visited by fetches. Removing an Entity more than
+     * once before the merge is harmless.
      * 
      * @param e 
      */
     void WorldResource::remove_entity(Entity *e)
     {
-        e->flag_for_removal();
+        this->local_buffer().push(ecs::command::Phase::Despawn, {e->eid(), this->world_ptr->get_cid<Entity>(), nullptr, &WorldResource::apply_despawn, nullptr});
     }
 
     /**
-     * @brief Stage an entity for removal
+     * @brief Performes all the removals and additions from systems after their execution
      * 
-     * This assumes that all but the Entity component itself has been removed. 
+     * The Commands of every thread are applied one phase at a time: every addition, then
+     * every removal, then every Entity removal. Removing an Entity removes its remaining
+     * components, so Entities must be removed last, else a later Command could refer to
+     * an Entity which no longer exists. Each removal is a constant time swap with the
+     * last element of the RegistryNode, so no other Entity has to be adjusted afterwards.
      * 
-     * @param e 
-     */
-    void WorldResource::stage_entity_for_removal(Entity *e)
-    {
-
-        // --- CRITICAL SECTION ---
-        this->mutex_guard.lock();
-        if (e->is_staged_for_removal())
-        {
-            this->mutex_guard.unlock();
-            return;
-        }
-        e->set_staged_for_removal();
-        this->mutex_guard.unlock();
-        // --- END OF CRITICAL SECTION ---
-
-        // Get the component id of T.
-        size_t cid = this->world_ptr->get_cid<Entity>();
-
-        // Get the index of the component to be removed.
-        size_t entity_component_index = e->get_component(cid);
-
-        // Fetch the RegistryNode for the component
-        RegistryNode *node_ptr = this->world_ptr->find<Entity>();
-
-        // Create a lambda function to delete the component instance, and remove the
-        // entity's knowledge of the component.
-        auto f = [node_ptr, entity_component_index, e, cid]() {
-            node_ptr->erase<Entity>(entity_component_index); // Delete the Entity Component
-        };
-
-        // Add the lambda function to be called later paired with the component index.
-        this->remove_functions.push_back(std::make_tuple(cid, entity_component_index, std::move(f)));
-    }
-
-    /**
-     * @brief Performes all the removals and additions from systems after their execution
+     * @exception Rethrows the first exception thrown by a Command, once every other
+     *            Command has been applied and the buffers are empty. The component of a
+     *            Command which throws is destroyed, and so are the components of the
+     *            Entities built by a thread whose Spawn phase throws.
      */
     void WorldResource::merge()
     {
-        for (auto &f : this->add_functions)
-            f();
-
-        this->add_functions.clear();
-
-        // If nothing to remove, return early for faster execution.
-        if (this->remove_functions.size() == 0)
-            return;
-
-        /** 
-         * Create lambda function for sorting the list in cid decreasing order.
-         * If the cid is the same, then sort by idx in decreasing order.
-         * 
-         * It is important that for each Component the greatest indicies are removed
-         * first, because otherwise, the following indicies may no longer be correct.
-         * 
-         * It MUST be garanteed that the Entity Component is operated on last, else 
-         * it is possible that removing an Entity, would influence the pointers that are
-         * being used in these lambda functions. Because it is GUARANTEED that the Entity
-         * Component is registred first, it will ALWAYS have the lowest CID, thus it is 
-         * sufficient to operate on Components with decending CID.
-         */
-        auto function_order_sort = [](std::tuple<size_t, size_t, std::function<void()>> lhs, std::tuple<size_t, size_t, std::function<void()>> rhs) {
-            if (std::get<0>(lhs) > std::get<0>(rhs))
-                return true;
-            return std::get<1>(lhs) > std::get<1>(rhs);
-        };
-
-        // Sort the list as described above.
-        std::sort(this->remove_functions.begin(), this->remove_functions.end(), function_order_sort);
-
-        // Remove all the components staged for removal.
-        for (auto tuple : this->remove_functions)
+        std::exception_ptr error = nullptr;
+        for (auto &buffer : this->buffers)
         {
-            size_t cid = std::get<0>(tuple);
-            size_t idx = std::get<1>(tuple);
-            auto f = std::get<2>(tuple);
-            f();
+            try
+            {
+                this->world_ptr->spawn(buffer->commands(ecs::command::Phase::Spawn));
+            }
+            catch (...)
+            {
+                if (!error)
+                    error = std::current_exception();
+            }
         }
 
-        // Adjust indicies of every Entity effected.
-        RegistryNode *entity_node = this->world_ptr->find<Entity>();
-        for (auto &e : *(entity_node->iter<Entity>()))
+        const ecs::command::Phase phases[] = {ecs::command::Phase::Add, ecs::command::Phase::Remove, ecs::command::Phase::Despawn};
+        for (auto phase : phases)
         {
-            for (auto tuple : this->remove_functions)
+            for (auto &buffer : this->buffers)
             {
-                size_t cid = std::get<0>(tuple);
-                size_t idx = std::get<1>(tuple);
-                // The component MUST be valid, otherwise it may have been removed already.
-                if (e.has_valid_component(cid))
+                for (auto &command : buffer->commands(phase))
                 {
-                    size_t e_idx = e.get_component(cid);
-
-                    if (e_idx > idx)
+                    try
+                    {
+                        command.apply(this->world_ptr, command);
+                    }
+                    catch (...)
                     {
-                        e.decrement_component(cid);
+                        if (!error)
+                            error = std::current_exception();
                     }
                 }
             }
         }
-        // Empty the lists for the next systems.
-        this->remove_functions.clear();
-    }
 
-} // namespace ecs::world
+        // Empty the buffers for the next systems.
+        for (auto &buffer : this->buffers)
+            buffer->clear();
 
-namespace ecs::dispatch
-{
+        if (error)
+            std::rethrow_exception(error);
+    }
 
     /**
-     * @brief Executables are an abstarct class which defines an exec function
+     * @brief Checks if any Commands are waiting to be merged.
      * 
-     * The idea behind this is that Systems require a parameter pack, thus Systems which
-     * require different parameter types, cannot be stored in a container (easily). 
-     * 
-     * Regardless of the parameters the Systems use, the functionality to fetch and run
-     * each system can be abstracted away into a single exec() function. That is what 
-     * this abstract class provides. Now, a dispatcher can be a container of Executable*
-     * and call the exec() function as defined by the System class, meaning the user does
-     * not have to do any additional implementation beyond the System::run() function. 
+     * This is safe to call while Systems are running.
      * 
+     * @return true
+     * @return false
      */
-    class Executable
+    bool WorldResource::has_commands() const
     {
-    public:
-        virtual void exec(ecs::world::World *) = 0;
-    };
+        for (auto &buffer : this->buffers)
+        {
+            if (buffer->has_commands())
+                return true;
+        }
+        return false;
+    }
 
-} // namespace ecs::dispatch
+} // namespace ecs::world
 
 namespace ecs::world
 {
     /**
      * @brief Runs each system which has been added to the world in order.
      * 
+     * The Systems are run as a task graph: a System is queued on the ThreadPool as soon
+     * as the last of its dependencies finishes, rather than waiting for a whole stage of
+     * Systems to finish. Systems added with add_main_thread_system() are run by the
+     * calling thread, which also runs queued Systems while it waits.
+     * 
+     * Each task runs whichever ready System has the highest priority, so the Systems on
+     * the costliest path through the graph are started first. The run time of every
+     * System is measured, and the priorities are planned again after a dispatch in
+     * which the costs have shifted, see ecs::dispatch::plan().
+     * 
+     * While tracing is enabled, the run of each System and merge, and the dispatch as a
+     * whole, are recorded by the Tracer of the World, see World::enable_tracing().
+     * 
+     * The Commands of the WorldResource can only be merged while no System is running.
+     * When a System which may make Commands finishes while Commands are waiting, the
+     * Systems which become ready are held back until every running System has finished,
+     * and the Commands are merged before they run, so that a System always sees the
+     * changes made by its dependencies. When no Commands are made, the Systems are never
+     * stopped to merge. Any remaining Commands are merged at the end of the dispatch.
+     * 
      * Note: This function *NOT* System-Safe.
      *      Calling this functio using the WorldResource from within a function could
      *      easily break the mutual exclusion guarantees of System Dependencies.
+     * 
+     * @exception Rethrows the first exception thrown by a System or a merge, once every
+     *            System has finished. The Systems depending on the System which threw are
+     *            not run, and neither are the Systems held back for a merge which threw.
      */
     void World::dispatch()
     {
+        auto dispatch_start = ecs::trace::Clock::now();
         RegistryNode *world_res_node = this->find<WorldResource>();
         WorldResource *world_res = world_res_node->get<WorldResource>(0);
-        for (auto &stage : this->systems)
+        world_res->reserve_buffers(this->workers->size() + 1);
+        this->dispatching = true;
+        ecs::trace::Tracer *tracer = this->tracer_ptr.get();
+
+        auto &nodes = this->systems;
+        std::unique_ptr<std::atomic<size_t>[]> waiting(new std::atomic<size_t>[nodes.size()]);
+        std::unique_ptr<std::atomic<bool>[]> needs_merge(new std::atomic<bool>[nodes.size()]);
+        std::unique_ptr<std::atomic<bool>[]> skipped(new std::atomic<bool>[nodes.size()]);
+        for (size_t i = 0; i < nodes.size(); i++)
         {
-            if (stage.size() > 1)
+            waiting[i] = nodes[i].n_dependencies;
+            needs_merge[i] = false;
+            skipped[i] = false;
+        }
+
+        ecs::thread_pool::TaskGroup group;
+        std::atomic<size_t> running(0);
+        std::mutex guard;
+        std::priority_queue<std::pair<double, size_t>> ready_queue;
+        std::vector<size_t> main_ready;
+        std::vector<size_t> held;
+        std::exception_ptr error = nullptr;
+        auto fail = [&](std::exception_ptr e) {
+            std::lock_guard<std::mutex> lock(guard);
+            if (!error)
+                error = e;
+        };
+
+        std::function<void(size_t)> launch;
+        std::function<void(size_t)> finish = [&](size_t i) {
+            bool merge = nodes[i].commands && world_res->has_commands();
+            for (size_t next : nodes[i].successors)
             {
-                /**
-                 * @brief Start a thread for every `stage` in the dispatcher
-                 * 
-                 * Safety:
-                 *  - The DispatcherBuilder will ensure that systems will run after their
-                 *    dependencies have finished executing. 
-                 *  - It is the PROGRAMMER'S responsibility to ensure that the dependencies
-                 *    of systems are properly specified.
-                 * 
-                 */
-                std::vector<std::thread> threads;
-                for (auto sys : stage)
+                if (merge)
+                    needs_merge[next] = true;
+                if (skipped[i])
+                    skipped[next] = true;
+                if (--waiting[next] != 0)
+                    continue;
+                if (needs_merge[next])
                 {
-                    auto lambda_f = [sys](ecs::world::World *w) {
-                        sys->exec(w);
-                    };
-                    std::thread t(lambda_f, this);
-                    threads.push_back(std::move(t));
+                    std::lock_guard<std::mutex> lock(guard);
+                    held.push_back(next);
                 }
-
-                // Wait for each thread to join before moving to the next stage.
-                for (int i = 0; i < threads.size(); i++)
+                else
                 {
-                    threads.at(i).join();
+                    launch(next);
                 }
             }
-            else // If only one system in a stage, run in the main thread.
+            running--;
+        };
+        auto exec = [&](size_t i) {
+            if (skipped[i])
+                return;
+            try
+            {
+                auto start = ecs::trace::Clock::now();
+                nodes[i].system->exec(this);
+                auto end = ecs::trace::Clock::now();
+                nodes[i].record_cost(std::chrono::duration<double, std::nano>(end - start).count());
+                if (tracer)
+                    tracer->record(this->workers->thread_index(), nodes[i].name, "system", start, end);
+            }
+            catch (...)
             {
-                for (auto sys : stage)
-                    sys->exec(this);
+                skipped[i] = true;
+                fail(std::current_exception());
+            }
+        };
+        launch = [&](size_t i) {
+            running++;
+            {
+                std::lock_guard<std::mutex> lock(guard);
+                if (nodes[i].main_thread)
+                {
+                    main_ready.push_back(i);
+                    return;
+                }
+                // Ties go to the System which was added first.
+                ready_queue.push(std::make_pair(nodes[i].priority, nodes.size() - i));
             }
-            // Perform any removals required now that all threads have joined.
-            world_res->merge();
+            this->workers->run(group, [&]() {
+                size_t next;
+                {
+                    std::lock_guard<std::mutex> lock(guard);
+                    next = nodes.size() - ready_queue.top().second;
+                    ready_queue.pop();
+                }
+                exec(next);
+                finish(next);
+            });
+        };
+
+        // The workers must be joined, and dispatching reset, whatever happens, since the
+        // tasks refer to the state of this dispatch.
+        try
+        {
+            for (size_t i = 0; i < nodes.size(); i++)
+            {
+                if (nodes[i].n_dependencies == 0)
+                    launch(i);
+            }
+
+            while (true)
+            {
+                // Run the main thread Systems, and help the workers, until no System is running.
+                while (running > 0)
+                {
+                    size_t next = nodes.size();
+                    {
+                        std::lock_guard<std::mutex> lock(guard);
+                        if (!main_ready.empty())
+                        {
+                            auto best = main_ready.begin();
+                            for (auto it = main_ready.begin(); it != main_ready.end(); it++)
+                            {
+                                if (nodes[*it].priority > nodes[*best].priority)
+                                    best = it;
+                            }
+                            next = *best;
+                            main_ready.erase(best);
+                        }
+                    }
+                    if (next != nodes.size())
+                    {
+                        exec(next);
+                        finish(next);
+                    }
+                    else if (!this->workers->run_one())
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+
+                // Every System has finished, so the changes can be applied.
+                if (world_res->has_commands())
+                {
+                    auto merge_start = ecs::trace::Clock::now();
+                    try
+                    {
+                        world_res->merge();
+                    }
+                    catch (...)
+                    {
+                        // The held Systems would miss changes of their dependencies, so they
+                        // are skipped like the dependents of a System which threw.
+                        for (size_t i : held)
+                            skipped[i] = true;
+                        fail(std::current_exception());
+                    }
+                    if (tracer)
+                        tracer->record(0, "merge", "merge", merge_start, ecs::trace::Clock::now());
+                }
+                if (held.empty())
+                    break;
+
+                std::vector<size_t> ready;
+                ready.swap(held);
+                for (size_t i : ready)
+                    launch(i);
+            }
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+        try
+        {
+            this->workers->wait(group);
         }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+        this->dispatching = false;
+
+        if (ecs::dispatch::costs_changed(nodes))
+            ecs::dispatch::plan(nodes);
+        if (tracer)
+            tracer->record(0, "dispatch", "dispatch", dispatch_start, ecs::trace::Clock::now());
+
+        if (error)
+            std::rethrow_exception(error);
     }
 } // namespace ecs::world
 #endif
\ No newline at end of file
@@ -60,15 +60,17 @@ namespace pong::components
     };
 
     /**
-     * @brief Ball Marker Component
+     * @brief Ball Component
      * 
-     * This doesn't have any associated data, but is used as an identifier for 'Ball' type
-     * Entities.
+     * Used as an identifier for 'Ball' type Entities. It holds the speed of the 'Ball',
+     * and the Position the 'Ball' was at when the current frame started, which is set by
+     * the BallWallCollisionSystem before the 'Ball' bounces.
      * 
      */
     struct Ball
     {
         float speed;
+        Position start;
     };
 
     /**
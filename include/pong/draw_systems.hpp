@@ -0,0 +1,83 @@
+#ifndef ecs_pong_draw_systems_hpp
+#define ecs_pong_draw_systems_hpp
+
+#include <pong/components.hpp>
+#include <ecs/system.hpp>
+#include <ecs/world.hpp>
+#include <GL/glut.h>
+
+namespace pc = pong::components;
+
+namespace pong::systems
+{
+    /**
+     * @brief System for drawing shapes to the screen
+     * 
+     * Components:
+     *      - Position
+     *      - Rectangle 
+     *      - Color3
+     * Note:
+     *      Must be executed in the main thread in order for the Entities to be drawn properly.
+     */
+    class DrawSystem : public ecs::system::System<const pc::Position, const pc::Rectangle, const pc::Color3>
+    {
+    private:
+        float WINDOW_SIZE;
+
+    public:
+        DrawSystem(float window_size) : WINDOW_SIZE(window_size) {}
+        ~DrawSystem() = default;
+        float convert_from_pixel(float pixel) { return pixel / WINDOW_SIZE; }
+        void run(system_data data)
+        {
+            auto pos = std::get<0>(data);
+            auto rect = std::get<1>(data);
+            auto color = std::get<2>(data);
+            glColor3f(color->r, color->g, color->b);
+            glRectf(
+                convert_from_pixel(pos->x),
+                convert_from_pixel(pos->y),
+                convert_from_pixel(pos->x + rect->width),
+                convert_from_pixel(pos->y - rect->height));
+        }
+    };
+
+    /**
+     * @brief System for drawing the Score to the screen. 
+     * 
+     * Components:
+     *      - Position
+     *      - Color 3 
+     *      - Side
+     *      - Score Resource
+     *      - FontWrapper
+     * 
+     * Note:
+     *      This must be run in the main thread in order for the text to be drawn properly.
+     * 
+     */
+    class DrawTextSystem : public ecs::system::System<const pc::Position, const pc::Color3, const pc::Text>
+    {
+    private:
+        float WINDOW_SIZE;
+
+    public:
+        DrawTextSystem(float window_size) : WINDOW_SIZE(window_size) {}
+        ~DrawTextSystem() = default;
+        float convert_from_pixel(float pixel) { return pixel / WINDOW_SIZE; }
+        void run(system_data data)
+        {
+            auto pos = std::get<0>(data);
+            auto color = std::get<1>(data);
+            auto text = std::get<2>(data);
+
+            glColor3f(color->r, color->g, color->b);
+            glRasterPos2f(convert_from_pixel(pos->x), convert_from_pixel(pos->y));
+            for (auto &c : text->str)
+                glutBitmapCharacter(GLUT_BITMAP_TIMES_ROMAN_24, c);
+        }
+    };
+} // namespace pong::systems
+
+#endif
@@ -5,8 +5,10 @@
 #include <pong/resources.hpp>
 #include <ecs/system.hpp>
 #include <ecs/world.hpp>
-#include <GL/glut.h>
+#include <ecs/spatial.hpp>
 #include <math.h>
+#include <cmath>
+#include <limits>
 #include <random>
 
 namespace pc = pong::components;
@@ -14,6 +16,18 @@ namespace pr = pong::resource;
 
 namespace pong::systems
 {
+    /**
+     * @brief Finds the bounding box of a rectangle, whose Position is its top left corner.
+     * 
+     * @param pos 
+     * @param rect 
+     * @return ecs::spatial::AABB 
+     */
+    inline ecs::spatial::AABB bounding_box(const pc::Position *pos, const pc::Rectangle *rect)
+    {
+        return {pos->x, pos->y - rect->height, pos->x + rect->width, pos->y};
+    }
+
     /**
      * @brief Movement System
      * 
@@ -23,18 +37,24 @@ namespace pong::systems
      * 
      * Updates Every Position based on it's velocity.
      * 
+     * Each Entity is moved independently, so this is a BatchSystem. The Positions are
+     * updated a Span at a time, in a loop the compiler can vectorize.
+     * 
      */
-    class MovementSystem : public ecs::system::System<pc::Position, pc::Velocity>
+    class MovementSystem : public ecs::system::BatchSystem<pc::Position, const pc::Velocity>
     {
     public:
         MovementSystem() = default;
         ~MovementSystem() = default;
-        void run(system_data data)
+        void run(batch_data data)
         {
             auto pos = std::get<0>(data);
             auto vel = std::get<1>(data);
-            pos->x += vel->dx;
-            pos->y += vel->dy;
+            for (size_t i = 0; i < pos.size(); i++)
+            {
+                pos[i].x += vel[i].dx;
+                pos[i].y += vel[i].dy;
+            }
         }
     };
 
@@ -49,6 +69,7 @@ namespace pong::systems
      *      - Entity
      *      - Score Resource
      *      - World Resource
+     *      - UniformGrid Resource
      * 
      * Checks if a 'Ball' Entity has collided with the edges of the screen.
      * 
@@ -67,15 +88,23 @@ namespace pong::systems
      * ScoreResource for increasing the score, and the WorldResource and Entity component
      * for removing the 'Ball' Entity.
      * 
+     * This is the last System to move a 'Ball' before the BallPaddleCollisionSystem
+     * searches the UniformGrid, so it also keeps the grid up to date: the box of every
+     * remaining 'Ball' is set to the box it swept through this frame, and removed 'Balls'
+     * are erased. The Position the 'Ball' started the frame at is found before it bounces,
+     * and kept in its Ball component, so the sweep always starts from where the 'Ball'
+     * really came from.
+     * 
      */
     class BallWallCollisionSystem : public ecs::system::System<
                                         pc::Position,
-                                        pc::Rectangle,
+                                        const pc::Rectangle,
                                         pc::Velocity,
                                         pc::Ball,
                                         pr::ScoreResource,
                                         ecs::world::WorldResource,
-                                        ecs::entity::Entity>
+                                        ecs::entity::Entity,
+                                        ecs::spatial::UniformGrid>
     {
 
     private:
@@ -90,20 +119,29 @@ namespace pong::systems
             auto pos = std::get<0>(data);
             auto rect = std::get<1>(data);
             auto vel = std::get<2>(data);
+            auto ball = std::get<3>(data);
             auto score = std::get<4>(data);
             auto world_res = std::get<5>(data);
             auto entity = std::get<6>(data);
+            auto grid = std::get<7>(data);
+
+            // Where the 'Ball' was before it moved this frame, before it bounces below.
+            ball->start = {pos->x - vel->dx, pos->y - vel->dy};
 
             // Check if colliding with the Left & Right sides of the screen.
             if (pos->x < -width)
             {
                 score->SCORE_RIGHT++;
                 world_res->remove_entity(entity);
+                grid->erase(entity->handle());
+                return;
             }
             else if (pos->x + rect->width > width)
             {
                 score->SCORE_LEFT++;
                 world_res->remove_entity(entity);
+                grid->erase(entity->handle());
+                return;
             }
 
             // Bounce of the top or bottom of the screen.
@@ -117,6 +155,9 @@ namespace pong::systems
                 pos->y = this->height;
                 vel->dy = -vel->dy;
             }
+
+            // The box swept since the start of the frame, so that fast 'Balls' are found too.
+            grid->update(entity->handle(), ecs::spatial::swept(bounding_box(&ball->start, rect), pos->x - ball->start.x, pos->y - ball->start.y));
         }
     };
 
@@ -128,11 +169,25 @@ namespace pong::systems
      *      - Rectangle 
      *      - Side
      *      - World Resource
+     *      - UniformGrid Resource
      * 
      * Checks if a 'Ball' is colliding with a paddle, and performs a 'Bounce' appropriately.
      * 
+     * The 'Balls' are found through the World Resource, so the Velocity it writes and the
+     * Ball it reads are declared in extra_access().
+     * 
+     * Only the 'Balls' which the UniformGrid finds near the paddle are checked, so the
+     * cost doesn't grow with the number of 'Balls' on the screen. The grid holds the box
+     * each 'Ball' swept through this frame, and the time each 'Ball' hit the paddle is
+     * found with ecs::spatial::time_of_impact(). The 'Ball' is moved back to where it
+     * first touched the paddle, so the cost of a collision doesn't depend on how deep
+     * the 'Ball' went, and a 'Ball' fast enough to pass through the paddle still bounces.
+     * The sweep starts from the Position kept in the Ball component by the
+     * BallWallCollisionSystem, so a 'Ball' which bounced off the top or bottom this frame
+     * is swept along the way it came, not a mirror image of it.
+     * 
      */
-    class BallPaddleCollisionSystem : public ecs::system::System<pc::Position, pc::Rectangle, pc::Side, ecs::world::WorldResource>
+    class BallPaddleCollisionSystem : public ecs::system::System<pc::Position, const pc::Rectangle, const pc::Side, ecs::world::WorldResource, const ecs::spatial::UniformGrid>
     {
     private:
         float MAX_BOUNCE_ANGLE;
@@ -140,33 +195,11 @@ namespace pong::systems
     public:
         BallPaddleCollisionSystem(float max_bounce_angle) : MAX_BOUNCE_ANGLE(max_bounce_angle) {}
         ~BallPaddleCollisionSystem() = default;
-        /**
-         * @brief Checks if two rectangles are colliding.
-         * 
-         * @param pos1 
-         * @param rect1 
-         * @param pos2 
-         * @param rect2 
-         * @return true 
-         * @return false 
-         */
-        bool overlap(pc::Position *pos1, pc::Rectangle *rect1, pc::Position *pos2, pc::Rectangle *rect2)
-        {
-            pc::Position l1 = *pos1;
-            pc::Position r1 = {pos1->x + rect1->width,
-                               pos1->y - rect1->height};
-
-            pc::Position l2 = *pos2;
-            pc::Position r2 = {pos2->x + rect2->width,
-                               pos2->y - rect2->height};
 
-            if (l1.x >= r2.x || l2.x >= r1.x)
-                return false;
-
-            if (l1.y <= r2.y || l2.y <= r1.y)
-                return false;
-
-            return true;
+        void extra_access(ecs::world::World *world_ptr, ecs::dispatch::Access &access) const
+        {
+            ecs::system::declare_access<pc::Velocity>(world_ptr, access);
+            ecs::system::declare_access<const pc::Ball>(world_ptr, access);
         }
 
         bool point_on_line(float x, float line_start, float line_end)
@@ -180,51 +213,55 @@ namespace pong::systems
             auto paddle_rect = std::get<1>(data);
             auto paddle_side = std::get<2>(data);
             auto world = std::get<3>(data);
+            auto grid = std::get<4>(data);
+            auto paddle_box = bounding_box(paddle_pos, paddle_rect);
 
-            // Do a fetch for the 'Balls' in the run function.
-            auto balls = world->world()->safe_fetch<pc::Position, pc::Rectangle, pc::Velocity, pc::Ball>();
-            for (auto ball : balls)
+            // Search the grid for the 'Balls' near the paddle.
+            for (auto handle : grid->query_aabb(paddle_box))
             {
+                auto ball_pos = world->world()->get_component<pc::Position>(handle);
+                auto ball_rect = world->world()->get_component<pc::Rectangle>(handle);
+                auto ball_vel = world->world()->get_component<pc::Velocity>(handle);
+                auto ball = world->world()->get_component<pc::Ball>(handle);
+                if (!ball_pos || !ball_rect || !ball_vel || !ball)
+                    continue;
+
+                // Sweep the 'Ball' from where it was at the start of the frame, so that fast
+                // 'Balls' which passed through the paddle are also found. The sweep ends
+                // where the 'Ball' is now, after any bounce off the top or bottom.
+                auto ball_box = bounding_box(ball_pos.get(), ball_rect.get());
+                pc::Position ball_start = ball->start;
+                float move_x = ball_pos->x - ball_start.x;
+                float move_y = ball_pos->y - ball_start.y;
+                float t = ecs::spatial::time_of_impact(bounding_box(&ball_start, ball_rect.get()), move_x, move_y, paddle_box);
+                if (t == std::numeric_limits<float>::infinity())
+                    continue;
+                // A 'Ball' which overlapped the paddle before it moved, and doesn't any more, is leaving it.
+                if (t < 0 && !ball_box.overlaps(paddle_box))
+                    continue;
+
+                // Fix the collision, by moving the 'Ball' back to where it first touched the paddle.
+                if (std::isfinite(t))
+                {
+                    ball_pos->x = ball_start.x + t * move_x;
+                    ball_pos->y = ball_start.y + t * move_y;
+                }
 
-                auto ball_pos = std::get<0>(ball);
-                auto ball_rect = std::get<1>(ball);
-                auto ball_vel = std::get<2>(ball);
-                auto ball_speed = std::get<3>(ball);
+                float ball_center = ball_pos->y - (ball_rect->height / 2.0);
+                float paddle_y_center = paddle_pos->y - (paddle_rect->height / 2.0);
+                float ball_y_relative_to_paddle = ball_center - paddle_y_center;
+                float ball_y_relative_to_paddle_normalized = ball_y_relative_to_paddle / (paddle_rect->height / 2.0);
 
-                if (overlap(paddle_pos, paddle_rect, ball_pos, ball_rect))
-                {
-                    float paddle_top = paddle_pos->y;
-                    float paddle_left = paddle_pos->x;
-                    float paddle_right = paddle_pos->x + paddle_rect->width;
-                    float paddle_bot = paddle_pos->y - paddle_rect->height;
-                    float ball_top = ball_pos->y;
-                    float ball_bot = ball_pos->y - ball_rect->height;
-                    float ball_left = ball_pos->x;
-                    float ball_right = ball_pos->x + ball_rect->width;
-
-                    float ball_center = ball_pos->y - (ball_rect->height / 2.0);
-                    float paddle_y_center = paddle_pos->y - (paddle_rect->height / 2.0);
-                    float ball_y_relative_to_paddle = ball_center - paddle_y_center;
-                    float ball_y_relative_to_paddle_normalized = ball_y_relative_to_paddle / (paddle_rect->height / 2.0);
-
-                    float ball_new_vel_dx_sign = (ball_vel->dx > 0 ? -1.0 : 1.0);
-
-                    // Correct case where ball center is above paddle
-                    if (std::abs(ball_y_relative_to_paddle_normalized) > 1.0)
-                        ball_y_relative_to_paddle_normalized = (ball_y_relative_to_paddle_normalized < 0 ? -1.0 : 1.0);
-
-                    // Fix the collision
-                    while (overlap(paddle_pos, paddle_rect, ball_pos, ball_rect))
-                    {
-                        ball_pos->x -= ball_vel->dx;
-                        ball_pos->y -= ball_vel->dy;
-                    }
+                float ball_new_vel_dx_sign = (ball_vel->dx > 0 ? -1.0 : 1.0);
 
-                    // Set the new velocity
-                    float new_x_vel = ball_speed->speed * cos(MAX_BOUNCE_ANGLE * ball_y_relative_to_paddle_normalized) * ball_new_vel_dx_sign;
-                    float new_y_vel = ball_speed->speed * sin(MAX_BOUNCE_ANGLE * ball_y_relative_to_paddle_normalized);
-                    *ball_vel = {new_x_vel, new_y_vel};
-                }
+                // Correct case where ball center is above paddle
+                if (std::abs(ball_y_relative_to_paddle_normalized) > 1.0)
+                    ball_y_relative_to_paddle_normalized = (ball_y_relative_to_paddle_normalized < 0 ? -1.0 : 1.0);
+
+                // Set the new velocity
+                float new_x_vel = ball->speed * cos(MAX_BOUNCE_ANGLE * ball_y_relative_to_paddle_normalized) * ball_new_vel_dx_sign;
+                float new_y_vel = ball->speed * sin(MAX_BOUNCE_ANGLE * ball_y_relative_to_paddle_normalized);
+                *ball_vel = {new_x_vel, new_y_vel};
             }
         }
     };
@@ -238,7 +275,7 @@ namespace pong::systems
      *      - Side
      * 
      */
-    class PaddleWallCollisionSystem : public ecs::system::System<pc::Position, pc::Rectangle, pc::Side>
+    class PaddleWallCollisionSystem : public ecs::system::System<pc::Position, const pc::Rectangle, const pc::Side>
     {
     private:
         float width;
@@ -264,80 +301,11 @@ namespace pong::systems
         }
     };
 
-    /**
-     * @brief System for drawing shapes to the screen
-     * 
-     * Components:
-     *      - Position
-     *      - Rectangle 
-     *      - Color3
-     * Note:
-     *      Must be executed in the main thread in order for the Entities to be drawn properly.
-     */
-    class DrawSystem : public ecs::system::System<pc::Position, pc::Rectangle, pc::Color3>
-    {
-    private:
-        float WINDOW_SIZE;
-
-    public:
-        DrawSystem(float window_size) : WINDOW_SIZE(window_size) {}
-        ~DrawSystem() = default;
-        float convert_from_pixel(float pixel) { return pixel / WINDOW_SIZE; }
-        void run(system_data data)
-        {
-            auto pos = std::get<0>(data);
-            auto rect = std::get<1>(data);
-            auto color = std::get<2>(data);
-            glColor3f(color->r, color->g, color->b);
-            glRectf(
-                convert_from_pixel(pos->x),
-                convert_from_pixel(pos->y),
-                convert_from_pixel(pos->x + rect->width),
-                convert_from_pixel(pos->y - rect->height));
-        }
-    };
-
-    /**
-     * @brief System for drawing the Score to the screen. 
-     * 
-     * Components:
-     *      - Position
-     *      - Color 3 
-     *      - Side
-     *      - Score Resource
-     *      - FontWrapper
-     * 
-     * Note:
-     *      This must be run in the main thread in order for the text to be drawn properly.
-     * 
-     */
-    class DrawTextSystem : public ecs::system::System<pc::Position, pc::Color3, pc::Text>
-    {
-    private:
-        float WINDOW_SIZE;
-
-    public:
-        DrawTextSystem(float window_size) : WINDOW_SIZE(window_size) {}
-        ~DrawTextSystem() = default;
-        float convert_from_pixel(float pixel) { return pixel / WINDOW_SIZE; }
-        void run(system_data data)
-        {
-            auto pos = std::get<0>(data);
-            auto color = std::get<1>(data);
-            auto text = std::get<2>(data);
-
-            glColor3f(color->r, color->g, color->b);
-            glRasterPos2f(convert_from_pixel(pos->x), convert_from_pixel(pos->y));
-            for (auto &c : text->str)
-                glutBitmapCharacter(GLUT_BITMAP_TIMES_ROMAN_24, c);
-        }
-    };
-
     /**
      * @brief System for updating the Score Text.
      * 
      */
-    class UpdateScoreTextSystem : public ecs::system::System<pc::Side, pc::Text, pr::ScoreResource>
+    class UpdateScoreTextSystem : public ecs::system::System<const pc::Side, pc::Text, const pr::ScoreResource>
     {
     public:
         UpdateScoreTextSystem() = default;
@@ -363,7 +331,7 @@ namespace pong::systems
      *      - Velocity
      *      - Keyboard Resource
      */
-    class KeyboardSystem : public ecs::system::System<pc::Side, pc::Velocity, pr::KeyboardResource>
+    class KeyboardSystem : public ecs::system::System<const pc::Side, pc::Velocity, const pr::KeyboardResource>
     {
     private:
         float paddle_velocity;
@@ -440,9 +408,7 @@ namespace pong::systems
 
             if (keyboard_res->SHOULD_SPAWN_BALL)
             {
-                ecs::registry::RegistryNode *ball_node;
-                ball_node = world_res->world()->find<pc::Ball>();
-                if (ball_node->size<pc::Ball>() < MAX_BALLS)
+                if (world_res->world()->count<pc::Ball>() < MAX_BALLS)
                 {
                     float angle = generate_random_angle();
                     int x_sign = rand() % 2;
@@ -495,14 +461,14 @@ namespace pong::systems
         }
     };
 
-    struct EntityCountSystem : public ecs::system::System<pc::EntityCounter, pc::Text, ecs::world::WorldResource>
+    struct EntityCountSystem : public ecs::system::System<const pc::EntityCounter, pc::Text, ecs::world::WorldResource>
     {
         void run(system_data data)
         {
             auto text = std::get<1>(data);
             auto world_res = std::get<2>(data);
 
-            size_t entity_count = world_res->world()->find<ecs::entity::Entity>()->size<ecs::entity::Entity>();
+            size_t entity_count = world_res->world()->count<ecs::entity::Entity>();
             text->str = std::to_string(entity_count) + " Entities";
         }
     };
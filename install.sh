@@ -12,5 +12,4 @@ fi
 sudo apt-get update
 sudo apt-get install mesa-utils
 sudo apt-get install freeglut3-dev
-sudo apt-get install libboost-all-dev
 sudo apt-get install doxygen
\ No newline at end of file